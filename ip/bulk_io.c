@@ -0,0 +1,165 @@
+/* Bulk file I/O for the IP conversion tools
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "bulk_io.h"
+
+/* Fallback for inputs that can't be mapped, e.g. pipes */
+static int read_all(struct bulk_in *in, int fd)
+{
+    unsigned char *buf = NULL;
+    size_t size = 0;
+    ssize_t n;
+
+    in->len = 0;
+    do {
+        if(in->len == size) {
+            unsigned char *t;
+
+            size = size ? size * 2 : 1 << 20;
+            t = realloc(buf, size);
+            if(t == NULL) {
+                free(buf);
+                return -1;
+            }
+            buf = t;
+        }
+        n = read(fd, buf + in->len, size - in->len);
+        if(n > 0)
+            in->len += n;
+    } while(n > 0 || (n < 0 && errno == EINTR));
+    if(n < 0) {
+        free(buf);
+        return -1;
+    }
+    in->data = buf;
+    in->mapped = 0;
+    return 0;
+}
+
+int bulk_in_open(struct bulk_in *in, const char *filename)
+{
+    struct stat st;
+    void *p;
+    int fd;
+    int ret;
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return -1;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            in->data = p;
+            in->len = st.st_size;
+            in->mapped = 1;
+            close(fd);
+            return 0;
+        }
+    }
+    ret = read_all(in, fd);
+    close(fd);
+    return ret;
+}
+
+void bulk_in_close(struct bulk_in *in)
+{
+    if(in->mapped)
+        munmap((void *)in->data, in->len);
+    else
+        free((void *)in->data);
+}
+
+int bulk_out_open(struct bulk_out *out, const char *filename)
+{
+    out->fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    out->iovcnt = 0;
+    out->copy_len = 0;
+    return out->fd < 0 ? -1 : 0;
+}
+
+int bulk_out_ref(struct bulk_out *out, const void *data, size_t len)
+{
+    struct iovec *last;
+
+    if(len == 0)
+        return 0;
+    /* Extend the previous entry if data directly follows it */
+    if(out->iovcnt > 0) {
+        last = &out->iov[out->iovcnt - 1];
+        if((const unsigned char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return 0;
+        }
+    }
+    if(out->iovcnt == BULK_OUT_IOV && bulk_out_flush(out) != 0)
+        return -1;
+    out->iov[out->iovcnt].iov_base = (void *)data;
+    out->iov[out->iovcnt].iov_len = len;
+    out->iovcnt++;
+    return 0;
+}
+
+int bulk_out_copy(struct bulk_out *out, const void *data, size_t len)
+{
+    if(len > BULK_OUT_COPY)
+        return -1;
+    /* Flush first, a flush must not happen between the copy and its
+     * reference as it recycles the copy buffer
+     */
+    if(out->copy_len + len > BULK_OUT_COPY || out->iovcnt == BULK_OUT_IOV)
+        if(bulk_out_flush(out) != 0)
+            return -1;
+    memcpy(out->copy + out->copy_len, data, len);
+    out->copy_len += len;
+    return bulk_out_ref(out, out->copy + out->copy_len - len, len);
+}
+
+int bulk_out_flush(struct bulk_out *out)
+{
+    struct iovec *iov = out->iov;
+    int iovcnt = out->iovcnt;
+    ssize_t n;
+
+    while(iovcnt > 0) {
+        n = writev(out->fd, iov, iovcnt);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        /* Skip what has been written, writes may be partial */
+        while(iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    out->iovcnt = 0;
+    out->copy_len = 0;
+    return 0;
+}
+
+int bulk_out_close(struct bulk_out *out)
+{
+    int ret;
+
+    ret = bulk_out_flush(out);
+    if(close(out->fd) != 0)
+        ret = -1;
+    return ret;
+}
@@ -0,0 +1,46 @@
+/* Bulk file I/O for the IP conversion tools
+ *
+ * Input files are memory-mapped so packets can be parsed in place, output
+ * is gathered into large writev batches that reference the input directly.
+ */
+
+#ifndef BULK_IO_H
+#define BULK_IO_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* Gather list entries and bytes of copied data per writev batch */
+#define BULK_OUT_IOV 1024
+#define BULK_OUT_COPY (BULK_OUT_IOV * 64)
+
+struct bulk_in {
+    const unsigned char *data; /* complete file contents */
+    size_t len;
+    int mapped; /* data is mmap()ed rather than malloc()ed */
+};
+
+struct bulk_out {
+    int fd;
+    struct iovec iov[BULK_OUT_IOV];
+    int iovcnt;
+    unsigned char copy[BULK_OUT_COPY]; /* small data such as headers */
+    size_t copy_len;
+};
+
+/* Make the whole file available in memory, returns 0 on success */
+int bulk_in_open(struct bulk_in *in, const char *filename);
+void bulk_in_close(struct bulk_in *in);
+
+/* Open filename for appending like fopen() mode "ab", returns 0 on success */
+int bulk_out_open(struct bulk_out *out, const char *filename);
+/* Queue len bytes by reference, data must stay valid until the next flush */
+int bulk_out_ref(struct bulk_out *out, const void *data, size_t len);
+/* Queue a copy of len bytes, for data built on the stack */
+int bulk_out_copy(struct bulk_out *out, const void *data, size_t len);
+/* Write out everything queued so far, returns 0 on success */
+int bulk_out_flush(struct bulk_out *out);
+/* Flush and close, returns 0 on success */
+int bulk_out_close(struct bulk_out *out);
+
+#endif /* BULK_IO_H */
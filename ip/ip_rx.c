@@ -0,0 +1,204 @@
+/* C bus model of the IPv4 receiver, see ip_rx.h
+ *
+ * The valid bytes of each Data_in word are taken as one block: header bytes
+ * are collected and checked as soon as the fields they complete are in,
+ * data bytes are appended behind the protocol and addresses and sent on
+ * Data_out a full word at a time.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "ip_rx.h"
+
+/* Flags and fragment offset field */
+#define IP_MF 0x2000
+#define IP_OFFMASK 0x1FFF
+
+int ip_rx_init(struct ip_rx_state *st, size_t width)
+{
+    if(width < 4 || width > IP_RX_WIDTH_MAX || (width & (width - 1)) != 0)
+        return -1;
+    memset(st, 0, sizeof(*st));
+    st->width = width;
+    return 0;
+}
+
+bool ip_rx_busy(const struct ip_rx_state *st)
+{
+    return st->queue_len != 0;
+}
+
+/* Queue len bytes from the front of out as a Data_out word */
+static void ip_rx_push(struct ip_rx_state *st, size_t len, bool end, bool err)
+{
+    struct ip_rx_out_word *w;
+
+    /* A full queue would overwrite words that have not gone out yet */
+    assert(st->queue_len < IP_RX_OUT_QUEUE_LEN);
+    w = &st->queue[(st->queue_head + st->queue_len) % IP_RX_OUT_QUEUE_LEN];
+    st->queue_len++;
+    memset(&w->bus, 0, sizeof(w->bus));
+    memcpy(w->bus.data, st->out, len);
+    if(len == IP_RX_WIDTH_MAX)
+        w->bus.valid = ~(uint64_t)0;
+    else
+        w->bus.valid = ((uint64_t)1 << len) - 1;
+    w->bus.start = !st->out_started;
+    w->bus.end = end;
+    w->bus.err = err;
+    w->data_len = st->data_len;
+    st->out_started = true;
+    st->out_len -= len;
+    memmove(st->out, st->out + len, st->out_len);
+}
+
+/* Checks once the whole header is in, returns the IP_RX_ERROR_* bits */
+static int ip_rx_header(struct ip_rx_state *st)
+{
+    const uint8_t *hdr = st->hdr;
+    unsigned int checksum;
+    unsigned int off;
+    size_t i;
+
+    checksum = 0;
+    for(i=0;i<st->hdr_len/2;i++) {
+        checksum += hdr[2*i]<<8;
+        checksum += hdr[2*i+1];
+    }
+    while(checksum > 0xFFFF)
+        checksum = (checksum>>16) + (checksum&0xFFFF);
+    if(checksum != 0xFFFF)
+        return IP_RX_ERROR_CHECKSUM;
+    /* the UDP checksum covers the whole datagram, so fragments are dropped
+     * like in pcap_to_udp_rx
+     */
+    off = (hdr[6]<<8) | hdr[7];
+    if(off & (IP_MF | IP_OFFMASK))
+        return IP_RX_ERROR_FRAGMENT;
+
+    st->proto = hdr[9];
+    memcpy(&st->addr_src, &hdr[12], sizeof(st->addr_src));
+    memcpy(&st->addr_dst, &hdr[16], sizeof(st->addr_dst));
+    st->data_len = st->total_len - st->hdr_len;
+    /* Data_out starts with the protocol and both addresses */
+    st->out[0] = st->proto;
+    memcpy(&st->out[1], &hdr[12], 8);
+    st->out_len = IP_RX_OUT_HDR_LEN;
+    return IP_RX_ERROR_NONE;
+}
+
+/* The valid bytes of one Data_in word, in lane order */
+static void ip_rx_word(struct ip_rx_state *st, const uint8_t *data, size_t len)
+{
+    size_t pos;
+    size_t n;
+
+    while(len > 0 && st->error == IP_RX_ERROR_NONE) {
+        pos = st->count;
+        if(pos < IP_RX_HDR_LEN_MIN || pos < st->hdr_len) {
+            n = (st->hdr_len ? st->hdr_len : IP_RX_HDR_LEN_MIN) - pos;
+            if(n > len)
+                n = len;
+            memcpy(&st->hdr[pos], data, n);
+            st->count += n;
+            data += n;
+            len -= n;
+            if(pos == 0) {
+                st->hdr_len = (st->hdr[0] & 0x0F)*4;
+                if((st->hdr[0] >> 4) != 4 || st->hdr_len < IP_RX_HDR_LEN_MIN)
+                    st->error = IP_RX_ERROR_VERSION;
+            }
+            if(pos < 4 && st->count >= 4) {
+                st->total_len = (st->hdr[2]<<8) | st->hdr[3];
+                if(st->total_len < st->hdr_len)
+                    st->error |= IP_RX_ERROR_LENGTH;
+            }
+            if(st->error == IP_RX_ERROR_NONE && st->count == st->hdr_len)
+                st->error = ip_rx_header(st);
+            continue;
+        }
+        /* Anything past the total length is Ethernet padding */
+        n = pos < st->total_len ? st->total_len - pos : 0;
+        if(n > len)
+            n = len;
+        memcpy(&st->out[st->out_len], data, n);
+        st->out_len += n;
+        st->count += len;
+        len = 0;
+    }
+    /* Always hold back at least one byte for Data_out_end */
+    while(st->out_len > st->width)
+        ip_rx_push(st, st->width, false, false);
+}
+
+/* Input of the packet is over, error is why it was cut short if it was */
+static int ip_rx_end(struct ip_rx_state *st, int error)
+{
+    st->active = false;
+    error |= st->error;
+    if(error == IP_RX_ERROR_NONE && (st->count < st->hdr_len
+            || st->count < st->total_len || st->hdr_len == 0))
+        error = IP_RX_ERROR_LENGTH;
+    if(error != IP_RX_ERROR_NONE) {
+        /* The data already sent has to be thrown away by the receiver */
+        st->out_len = 0;
+        if(st->out_started)
+            ip_rx_push(st, 0, true, true);
+        return error;
+    }
+    while(st->out_len > st->width)
+        ip_rx_push(st, st->width, false, false);
+    ip_rx_push(st, st->out_len, true, false);
+    return IP_RX_ERROR_NONE;
+}
+
+int ip_rx_clock(struct ip_rx_state *st, const struct ip_rx_bus *in,
+        struct ip_rx_bus *out)
+{
+    uint8_t data[IP_RX_WIDTH_MAX];
+    const struct ip_rx_out_word *w;
+    size_t len;
+    size_t i;
+    int ret;
+
+    ret = IP_RX_ERROR_NONE;
+    if(in->start) {
+        /* Data_in_start without Data_in_end for the previous packet */
+        if(st->active)
+            ret |= ip_rx_end(st, IP_RX_ERROR_INPUT);
+        st->active = true;
+        st->error = IP_RX_ERROR_NONE;
+        st->count = 0;
+        st->hdr_len = 0;
+        st->total_len = 0;
+        st->data_len = 0;
+        st->out_len = 0;
+        st->out_started = false;
+    }
+    if(st->active) {
+        if(in->err) {
+            ret |= ip_rx_end(st, IP_RX_ERROR_INPUT);
+        } else {
+            len = 0;
+            for(i=0;i<st->width;i++)
+                if(in->valid & ((uint64_t)1 << i))
+                    data[len++] = in->data[i];
+            ip_rx_word(st, data, len);
+            if(in->end)
+                ret |= ip_rx_end(st, IP_RX_ERROR_NONE);
+        }
+    }
+
+    if(st->queue_len == 0) {
+        memset(out, 0, sizeof(*out));
+        return ret;
+    }
+    w = &st->queue[st->queue_head];
+    *out = w->bus;
+    if(out->start)
+        st->out_data_len = w->data_len;
+    st->queue_head = (st->queue_head + 1) % IP_RX_OUT_QUEUE_LEN;
+    st->queue_len--;
+    return ret;
+}
@@ -0,0 +1,105 @@
+/* C bus model of the IPv4 receiver in ip_rx_component.vhd
+ *
+ * Each call of ip_rx_clock is one rising edge of Clk with the Data_in
+ * signals of that cycle, and gives the Data_out signals the model drives in
+ * the same cycle. The header is parsed and validated as its bytes arrive,
+ * the data section is realigned behind the protocol and addresses the same
+ * way as in the VHDL port description.
+ */
+
+#ifndef IP_RX_H
+#define IP_RX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Supported bus widths in bytes are powers of 2 from 4 to IP_RX_WIDTH_MAX */
+#define IP_RX_WIDTH_MAX 64
+#define IP_RX_HDR_LEN_MIN 20
+#define IP_RX_HDR_LEN_MAX 60
+/* Protocol and addresses ahead of the data section on Data_out */
+#define IP_RX_OUT_HDR_LEN 9
+
+/* Why the current packet was dropped or ended with Data_out_err */
+#define IP_RX_ERROR_NONE 0x0
+#define IP_RX_ERROR_INPUT 0x1 /* Data_in_err */
+#define IP_RX_ERROR_VERSION 0x2 /* not IPv4 or header length below 20 */
+#define IP_RX_ERROR_CHECKSUM 0x4 /* header checksum */
+#define IP_RX_ERROR_LENGTH 0x8 /* shorter than its total length field */
+#define IP_RX_ERROR_FRAGMENT 0x10 /* the UDP checksum needs all fragments */
+
+/* Signals of a bus in one clock cycle */
+struct ip_rx_bus {
+    uint8_t data[IP_RX_WIDTH_MAX]; /* Data, byte lane i is data[i] */
+    uint64_t valid; /* Data_valid, bit i set if lane i is valid */
+    bool start;
+    bool end;
+    bool err;
+};
+
+/* Depth of the Data_out queue in bus words. Packets get shorter on the way
+ * through, so a word or two of backlog at the end of a packet is all it
+ * ever holds.
+ */
+#define IP_RX_OUT_QUEUE_LEN 8
+
+struct ip_rx_out_word {
+    struct ip_rx_bus bus;
+    size_t data_len;
+};
+
+struct ip_rx_state {
+    size_t width;
+    /* Input side, between Data_in_start and Data_in_end */
+    bool active;
+    int error;
+    size_t count; /* packet bytes received, including padding */
+    uint8_t hdr[IP_RX_HDR_LEN_MAX];
+    size_t hdr_len; /* from the header, 0 until received */
+    size_t total_len; /* from the header, 0 until received */
+    /* Header fields once the header is complete and valid */
+    uint8_t proto;
+    uint32_t addr_src; /* network byte order */
+    uint32_t addr_dst; /* network byte order */
+    size_t data_len; /* IP data section length */
+    /* Data_out bytes not yet sent. The last bytes of a packet are held back
+     * until Data_in_end so Data_out_end and Data_out_err can go with them.
+     */
+    uint8_t out[2 * IP_RX_WIDTH_MAX + IP_RX_OUT_HDR_LEN];
+    size_t out_len;
+    bool out_started;
+    struct ip_rx_out_word queue[IP_RX_OUT_QUEUE_LEN];
+    size_t queue_head;
+    size_t queue_len;
+    /* Data section length of the packet on Data_out, a sideband for the
+     * UDP receiver set along with Data_out_start
+     */
+    size_t out_data_len;
+};
+
+/* Set up st for a bus of width bytes, same as asserting Rst
+ *
+ * Returns 0 on success and -1 for unsupported widths
+ */
+int ip_rx_init(struct ip_rx_state *st, size_t width);
+
+/* One clock cycle
+ *
+ * in: Data_in signals of the cycle, all zero for an idle cycle
+ * out: Data_out signals driven in the cycle
+ *
+ * Returns the IP_RX_ERROR_* bits of a packet whose input ended in this
+ * cycle, 0 if there was none or it was good. A bad packet is dropped
+ * without any Data_out if it fails before Data_out_start, e.g. for a bad
+ * header, otherwise its last Data_out word has Data_out_err.
+ */
+int ip_rx_clock(struct ip_rx_state *st, const struct ip_rx_bus *in,
+        struct ip_rx_bus *out);
+
+/* Whether Data_out has words queued, i.e. more cycles are needed to send
+ * packets that have ended
+ */
+bool ip_rx_busy(const struct ip_rx_state *st);
+
+#endif /* IP_RX_H */
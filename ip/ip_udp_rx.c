@@ -0,0 +1,274 @@
+/* Program to run IPv4 packets through the IP RX bus model chained into the
+ * UDP RX datapath
+ *
+ * Each packet of a file of concatenated IPv4 packets (as written by
+ * pcap_to_ipv4_udp) is put on the Data_in bus of the ip_rx model one word
+ * per clock cycle. Its Data_out words are realigned into UDP bus transfers
+ * and handed to udp_rx_pipeline as they come out, so no packet is ever
+ * buffered whole. The results are written as a stream of RX output records
+ * (see udp/record.h), the same records "udp rx --stream" gives for the
+ * packets of the file that pass the IPv4 checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include "bulk_io.h"
+#include "ip_rx.h"
+#include "record.h"
+#include "rx.h"
+
+struct chain_counts {
+    unsigned long packets;
+    unsigned long dropped; /* by ip_rx without any Data_out */
+    unsigned long aborted; /* ended with Data_out_err */
+    unsigned long records;
+    unsigned long errors; /* records with a non-zero status */
+    unsigned long cycles;
+    unsigned long bytes; /* Data_in bytes */
+};
+
+/* UDP receiver side of the Data_out bus */
+struct chain {
+    struct ip_rx_state ip;
+    struct udp_rx_state udp;
+    size_t count; /* Data_out bytes of the current packet */
+    uint8_t prefix[IP_RX_OUT_HDR_LEN]; /* protocol and addresses */
+    int udp_active; /* the data section goes through udp_rx_pipeline */
+    uint8_t status;
+    /* UDP bus transfer being filled */
+    uint8_t word[IP_RX_WIDTH_MAX];
+    size_t word_len;
+    /* RX output record */
+    uint8_t out[RECORD_MAX_LEN];
+    size_t out_len;
+    FILE *fp;
+    struct chain_counts counts;
+};
+
+static void chain_transfer(struct chain *c)
+{
+    size_t len;
+
+    udp_rx_pipeline(&c->udp, c->word, c->word_len, &c->out[c->out_len],
+            &len);
+    c->out_len += len;
+    c->word_len = 0;
+}
+
+/* Protocol and addresses are in, same checks as record_rx_dgram */
+static void chain_begin(struct chain *c)
+{
+    uint32_t addr_src, addr_dst;
+    size_t dgram_len;
+
+    memcpy(&addr_src, &c->prefix[1], sizeof(addr_src));
+    memcpy(&addr_dst, &c->prefix[5], sizeof(addr_dst));
+    dgram_len = c->ip.out_data_len;
+    c->out_len = RECORD_RX_OUT_HDR_LEN;
+    c->udp_active = 0;
+    c->status = RECORD_STATUS_OK;
+    if(dgram_len < UDP_HDR_LEN) {
+        c->status = RECORD_STATUS_MALFORMED;
+    } else if(c->prefix[0] == UDP_PROTO) {
+        udp_rx_start(&c->udp, addr_src, addr_dst, dgram_len);
+        c->udp_active = 1;
+    } else if(c->prefix[0] == UDPLITE_PROTO) {
+        udp_rx_start_lite(&c->udp, addr_src, addr_dst, dgram_len);
+        c->udp_active = 1;
+    } else {
+        c->status = RX_ERROR_NOT_UDP;
+    }
+    memcpy(&c->out[0], &addr_src, sizeof(addr_src));
+}
+
+static void chain_end(struct chain *c, int err)
+{
+    uint16_t port;
+
+    if(err) {
+        c->counts.aborted++;
+        return;
+    }
+    if(c->udp_active) {
+        if(c->word_len > 0)
+            chain_transfer(c);
+        c->status = udp_rx_finish(&c->udp);
+        port = htons(c->udp.hdr_udp_port_src);
+        memcpy(&c->out[4], &port, sizeof(port));
+        port = htons(c->udp.hdr_udp_port_dst);
+        memcpy(&c->out[6], &port, sizeof(port));
+    }
+    if(record_write(c->fp, c->status, c->out,
+            c->status == RECORD_STATUS_OK ? c->out_len : 0) != 0) {
+        fprintf(stderr, "error writing rx records\n");
+        exit(1);
+    }
+    c->counts.records++;
+    if(c->status != RECORD_STATUS_OK)
+        c->counts.errors++;
+}
+
+/* One Data_out word, the valid bytes are always at the low lanes */
+static void chain_out(struct chain *c, const struct ip_rx_bus *bus)
+{
+    const uint8_t *data = bus->data;
+    size_t len;
+    size_t n;
+
+    if(bus->start) {
+        c->count = 0;
+        c->word_len = 0;
+    }
+    for(len=0;len<c->ip.width && (bus->valid & ((uint64_t)1 << len));len++)
+        ;
+    if(c->count < IP_RX_OUT_HDR_LEN) {
+        n = IP_RX_OUT_HDR_LEN - c->count;
+        if(n > len)
+            n = len;
+        memcpy(&c->prefix[c->count], data, n);
+        c->count += n;
+        data += n;
+        len -= n;
+        if(c->count == IP_RX_OUT_HDR_LEN)
+            chain_begin(c);
+    }
+    c->count += len;
+    /* The data section starts 9 bytes into the first word, so each
+     * transfer is made of the end of one word and the start of the next
+     */
+    while(c->udp_active && len > 0) {
+        n = c->ip.width - c->word_len;
+        if(n > len)
+            n = len;
+        memcpy(&c->word[c->word_len], data, n);
+        c->word_len += n;
+        data += n;
+        len -= n;
+        if(c->word_len == c->ip.width)
+            chain_transfer(c);
+    }
+    if(bus->end)
+        chain_end(c, bus->err);
+}
+
+static void chain_clock(struct chain *c, const struct ip_rx_bus *in)
+{
+    struct ip_rx_bus out;
+
+    ip_rx_clock(&c->ip, in, &out);
+    if(out.valid || out.end)
+        chain_out(c, &out);
+    c->counts.cycles++;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *ip_filename;
+    const char *rx_filename;
+    struct bulk_in in;
+    static struct chain c;
+    struct ip_rx_bus bus;
+    const unsigned char *packet;
+    const unsigned char *end;
+    size_t packet_len;
+    size_t width;
+    size_t off;
+    size_t n;
+    int opt;
+
+    width = 8;
+    while((opt = getopt(argc, argv, "w:")) != -1) {
+        if(opt != 'w') {
+            fprintf(stderr, "Usage: %s [-w bus width] ipv4_file rx_file\n",
+                    argv[0]);
+            exit(1);
+        }
+        width = strtoul(optarg, NULL, 0);
+    }
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "Need exactly two arguments: ipv4 packets filename and desired output RX records filename (- for stdout)\n");
+        exit(1);
+    }
+
+    ip_filename = argv[optind];
+    rx_filename = argv[optind + 1];
+
+    if(ip_rx_init(&c.ip, width) != 0 || udp_rx_init(&c.udp, width) != 0) {
+        fprintf(stderr, "bus width must be a power of 2 from 4 to %d\n",
+                IP_RX_WIDTH_MAX);
+        exit(1);
+    }
+
+    if(bulk_in_open(&in, ip_filename) != 0) {
+        fprintf(stderr, "error reading ipv4 file\n");
+        exit(1);
+    }
+
+    /* Truncate rather than append so reruns give the same file */
+    if(strcmp(rx_filename, "-") == 0)
+        c.fp = stdout;
+    else
+        c.fp = fopen(rx_filename, "wb");
+    if(c.fp == NULL) {
+        fprintf(stderr, "error opening/creating rx records file\n");
+        exit(1);
+    }
+    setvbuf(c.fp, NULL, _IOFBF, 1 << 20);
+
+    /* Packets are framed by their total length fields, everything else
+     * about them is up to the model
+     */
+    packet = in.data;
+    end = in.data + in.len;
+    while(packet < end) {
+        if(end - packet < 4) {
+            fprintf(stderr, "IPv4 header ended early, exiting\n");
+            break;
+        }
+        packet_len = (packet[2]<<8) | packet[3];
+        if(packet_len < IP_RX_HDR_LEN_MIN
+                || packet_len > (size_t)(end - packet)) {
+            fprintf(stderr, "Corrupted ipv4 packet encountered, exiting\n");
+            break;
+        }
+
+        c.counts.packets++;
+        c.counts.bytes += packet_len;
+        for(off=0;off<packet_len;off+=width) {
+            n = packet_len - off < width ? packet_len - off : width;
+            memset(&bus, 0, sizeof(bus));
+            memcpy(bus.data, &packet[off], n);
+            bus.valid = n == IP_RX_WIDTH_MAX ? ~(uint64_t)0
+                    : ((uint64_t)1 << n) - 1;
+            bus.start = off == 0;
+            bus.end = off + n == packet_len;
+            chain_clock(&c, &bus);
+        }
+        packet += packet_len;
+    }
+    /* Idle cycles until the last packet is out */
+    memset(&bus, 0, sizeof(bus));
+    while(ip_rx_busy(&c.ip))
+        chain_clock(&c, &bus);
+    c.counts.dropped = c.counts.packets - c.counts.records - c.counts.aborted;
+
+    fprintf(stderr, "%lu packets, %lu dropped by ip_rx, %lu with "
+            "Data_out_err, %lu RX records (%lu with errors)\n",
+            c.counts.packets, c.counts.dropped, c.counts.aborted,
+            c.counts.records, c.counts.errors);
+    fprintf(stderr, "%lu cycles at width %zu, %.2f bytes per cycle\n",
+            c.counts.cycles, width, c.counts.cycles
+            ? (double)c.counts.bytes / c.counts.cycles : 0.0);
+    bulk_in_close(&in);
+    if(fclose(c.fp) != 0) {
+        fprintf(stderr, "error writing rx records\n");
+        exit(1);
+    }
+    return 0;
+}
@@ -7,18 +7,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "bulk_io.h"
+
+#define IP_HDR_LEN 20
+
 int main(int argc, char *argv[])
 {
     const char *ip_filename;
     const char *udp_filename;
-    FILE *rp;
-    FILE *wp;
+    struct bulk_in in;
+    static struct bulk_out out;
+    const unsigned char *ip_header;
+    const unsigned char *end;
     unsigned int ip_hdr_len;
-    int ip_header[20];
-    int current_byte;
-    int packet_length;
+    unsigned int packet_length;
+    unsigned int data_length;
+    unsigned int checksum;
     int i;
-    int checksum;
 
     if(argc != 3)
     {
@@ -29,36 +34,35 @@ int main(int argc, char *argv[])
     ip_filename = argv[1];
     udp_filename = argv[2];
 
-    rp = fopen(ip_filename, "rb");
-    if(rp == NULL) {
+    if(bulk_in_open(&in, ip_filename) != 0) {
         fprintf(stderr, "error reading ipv4 file\n");
         exit(1);
     }
 
-    wp = fopen(udp_filename, "ab");
-    if(wp == NULL) {
+    if(bulk_out_open(&out, udp_filename) != 0) {
         fprintf(stderr, "error opening/creating new udp file\n");
         exit(1);
     }
 
-    while((current_byte = fgetc(rp)) != EOF){
+    /* Packets are parsed in place in the input and their data sections are
+     * passed to the output by reference
+     */
+    ip_header = in.data;
+    end = in.data + in.len;
+    while(ip_header < end) {
         /* Check first byte to see if the packet is valid */
-        if((current_byte >> 4) & 0x0F != 4) {
+        if((ip_header[0] >> 4) != 4) {
             printf("Corrupted ipv4 packet encountered, exiting\n");
             break;
         }
-        ip_hdr_len = (int)(current_byte & 0x0F)*4;
+        ip_hdr_len = (ip_header[0] & 0x0F)*4;
         /* if(ip_hdr_len < 20 || ip_hdr_len > 60) { */
-        if(ip_hdr_len != 20) {
+        if(ip_hdr_len != IP_HDR_LEN) {
             printf("IPv4 header length either too short or too long, exiting\n");
             break;
         }
 
-        /* Store rest of header in array */
-        ip_header[0] = current_byte;
-        for(i=1;i<20;i++)
-            ip_header[i] = fgetc(rp);
-        if(ip_header[19] == EOF) {
+        if(end - ip_header < IP_HDR_LEN) {
             printf("IPv4 header ended early, exiting\n");
             break;
         }
@@ -76,20 +80,30 @@ int main(int argc, char *argv[])
             break;
         }
 
-        /* Write protocol type to file */
-        fputc(ip_header[9], wp);
-
-        /* Write source and destination addresses to file */
-        for(i=12; i<20; i++)
-            fputc(ip_header[i], wp);
-
-        /* Calculate packet length then copy rest of packet based on it */
+        /* Calculate packet length to find the rest of the packet */
         packet_length = (ip_header[2]<<8)|ip_header[3];
-        for(i=0; i<packet_length-ip_hdr_len; i++)
-            fputc(fgetc(rp), wp);
+        data_length = packet_length > ip_hdr_len ? packet_length - ip_hdr_len : 0;
+        if((size_t)(end - ip_header - ip_hdr_len) < data_length) {
+            printf("IPv4 packet ended early, exiting\n");
+            break;
+        }
+
+        /* Write protocol type, source and destination addresses and the
+         * rest of the packet to file
+         */
+        if(bulk_out_ref(&out, &ip_header[9], 1) != 0
+           || bulk_out_ref(&out, &ip_header[12], 8) != 0
+           || bulk_out_ref(&out, &ip_header[ip_hdr_len], data_length) != 0) {
+            fprintf(stderr, "error writing udp file\n");
+            exit(1);
+        }
+        ip_header += ip_hdr_len + data_length;
     }
 
-    fclose(rp);
-    fclose(wp);
+    if(bulk_out_close(&out) != 0) {
+        fprintf(stderr, "error writing udp file\n");
+        exit(1);
+    }
+    bulk_in_close(&in);
     return 0;
 }
@@ -0,0 +1,167 @@
+/* Program to run the UDP RX executable spec directly over a pcap file
+ *
+ * Combines pcap_to_ipv4_udp, ipv4_to_udp and "udp rx --stream" in a single
+ * pass without intermediate files. Each IPv4 UDP packet is validated and
+ * handed to udp_rx in place, the results are written as a stream of RX
+ * output records (see udp/record.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <net/if.h>
+#include <netinet/if_ether.h>
+
+#include <pcap.h>
+
+#include "record.h"
+
+struct rx_counts {
+    unsigned long packets;
+    unsigned long skipped; /* not IPv4 UDP, fragments or truncated */
+    unsigned long invalid; /* IPv4 header failed validation */
+    unsigned long records;
+    unsigned long errors; /* records with a non-zero status */
+};
+
+/* Same checks as ipv4_to_udp.c */
+static int ipv4_header_valid(const unsigned char *ip_header,
+            unsigned int ip_hdr_len)
+{
+    unsigned int checksum;
+    unsigned int i;
+
+    if((ip_header[0] >> 4) != 4 || ip_hdr_len < 20)
+        return 0;
+    checksum = 0;
+    for(i=0;i<ip_hdr_len/2;i++) {
+        checksum += ip_header[2*i]<<8;
+        checksum += ip_header[2*i+1];
+    }
+    while(checksum > 0xFFFF)
+        checksum = (checksum>>16) + (checksum&0xFFFF);
+    return checksum == 0xFFFF;
+}
+
+/* Follows dump_ipv4_packet in pcap_to_ipv4_udp.c, but runs the packet
+ * through the RX spec instead of dumping it
+ */
+void rx_ipv4_packet(const unsigned char *packet, unsigned int capture_len,
+            FILE *fp, struct rx_counts *counts)
+{
+    static uint8_t out[RECORD_MAX_LEN];
+    const struct ether_header *eth;
+    struct ip ip;
+    unsigned int ip_hdr_len;
+    unsigned int ip_len;
+    uint32_t addr_src, addr_dst;
+    size_t out_len;
+    uint8_t status;
+
+    counts->packets++;
+    if(capture_len < sizeof(struct ether_header))
+        goto skip;
+    eth = (const struct ether_header *)packet;
+    if(ntohs(eth->ether_type) != ETHERTYPE_IP)
+        goto skip;
+
+    /* skip Ethernet header */
+    packet += sizeof(struct ether_header);
+    capture_len -= sizeof(struct ether_header);
+
+    /* ip header not large enough */
+    if(capture_len < sizeof(struct ip))
+        goto skip;
+    memcpy(&ip, packet, sizeof(ip));
+    ip_hdr_len = ip.ip_hl * 4;
+    ip_len = ntohs(ip.ip_len);
+
+    /* not a UDP packet */
+    if(ip.ip_p != IPPROTO_UDP)
+        goto skip;
+    /* ip header or packet not as large as the fields say they are */
+    if(capture_len < ip_hdr_len || capture_len < ip_len || ip_len < ip_hdr_len)
+        goto skip;
+    /* fragments can't be checked without reassembly */
+    if(ntohs(ip.ip_off) & (IP_MF | IP_OFFMASK))
+        goto skip;
+    if(!ipv4_header_valid(packet, ip_hdr_len)) {
+        counts->invalid++;
+        return;
+    }
+
+    memcpy(&addr_src, &ip.ip_src, sizeof(addr_src));
+    memcpy(&addr_dst, &ip.ip_dst, sizeof(addr_dst));
+    status = record_rx_dgram(false, ip.ip_p, addr_src, addr_dst,
+                packet + ip_hdr_len, ip_len - ip_hdr_len, out, &out_len);
+    if(record_write(fp, status, out, out_len) != 0) {
+        fprintf(stderr, "error writing rx records\n");
+        exit(1);
+    }
+    counts->records++;
+    if(status != RECORD_STATUS_OK)
+        counts->errors++;
+    return;
+
+skip:
+    counts->skipped++;
+}
+
+int main(int argc, char *argv[])
+{
+    pcap_t *pcap;
+    const unsigned char *packet;
+    const char *pcap_filename;
+    const char *rx_filename;
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *header;
+    struct rx_counts counts;
+    FILE *fp;
+    int ret;
+
+    if(argc != 3)
+    {
+        fprintf(stderr, "Need exactly two arguments: pcap dump filename(.pcap) and desired output RX records filename (- for stdout)\n");
+        exit(1);
+    }
+
+    pcap_filename = argv[1];
+    rx_filename = argv[2];
+
+    pcap = pcap_open_offline(pcap_filename, errbuf);
+    if(pcap == NULL)
+    {
+        fprintf(stderr, "error reading pcap file: %s\n", errbuf);
+        exit(1);
+    }
+
+    /* Truncate rather than append so reruns give the same file */
+    if(strcmp(rx_filename, "-") == 0)
+        fp = stdout;
+    else
+        fp = fopen(rx_filename, "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "error opening/creating rx records file\n");
+        exit(1);
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    memset(&counts, 0, sizeof(counts));
+    while((ret = pcap_next_ex(pcap, &header, &packet)) == 1)
+        rx_ipv4_packet(packet, header->caplen, fp, &counts);
+    if(ret == -1)
+        fprintf(stderr, "error reading pcap file: %s\n", pcap_geterr(pcap));
+
+    fprintf(stderr, "%lu packets, %lu skipped, %lu invalid IPv4 headers, "
+            "%lu RX records (%lu with errors)\n", counts.packets,
+            counts.skipped, counts.invalid, counts.records, counts.errors);
+    pcap_close(pcap);
+    if(fclose(fp) != 0) {
+        fprintf(stderr, "error writing rx records\n");
+        exit(1);
+    }
+    return ret == -1 ? 1 : 0;
+}
@@ -7,17 +7,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "bulk_io.h"
+
+/* Addresses, protocol and UDP header of each input packet */
+#define APUH_LEN 17
+
 int main(int argc, char *argv[])
 {
     const char *ip_filename;
     const char *udp_filename;
-    FILE *rp;
-    FILE *wp;
-    int apuh[16]; /* Addresses plus udp header */
-    int current_byte;
+    struct bulk_in in;
+    static struct bulk_out out;
+    const unsigned char *apuh; /* Addresses plus udp header */
+    const unsigned char *end;
+    unsigned char ip_header[20];
     int i;
-    int packet_length;
-    int checksum;
+    unsigned int packet_length;
+    unsigned int data_length;
+    unsigned int checksum;
 
     if(argc != 3)
     {
@@ -28,33 +35,28 @@ int main(int argc, char *argv[])
     udp_filename = argv[1];
     ip_filename = argv[2];
 
-    rp = fopen(udp_filename, "rb");
-    if(rp == NULL) {
+    if(bulk_in_open(&in, udp_filename) != 0) {
         fprintf(stderr, "error reading udp file\n");
         exit(2);
     }
 
-    wp = fopen(ip_filename, "ab");
-    if(wp == NULL) {
+    if(bulk_out_open(&out, ip_filename) != 0) {
         fprintf(stderr, "error opening/creating new ip file\n");
         exit(3);
     }
 
-    while((current_byte = fgetc(rp)) != EOF){
-        current_byte = apuh[0];
-        for(i=1;i<16; i++) {
-            if(i==8) {
-                if(fgetc(rp) != 0x11)
-                    printf("Protocol byte isn't 0x11");
-            }
-            if((apuh[i] = fgetc(rp)) == EOF) {
-                printf("Reached end of packet during header read, exiting\n");
-                fclose(rp);
-                fclose(wp);
-                exit(4);
-            }
+    apuh = in.data;
+    end = in.data + in.len;
+    while(apuh < end) {
+        if(end - apuh < APUH_LEN) {
+            printf("Reached end of packet during header read, exiting\n");
+            bulk_out_close(&out);
+            bulk_in_close(&in);
+            exit(4);
         }
-        packet_length = (apuh[12]<<8)+apuh[13];
+        if(apuh[8] != 0x11)
+            printf("Protocol byte isn't 0x11");
+        packet_length = (apuh[13]<<8)+apuh[14];
         packet_length += 20;
 
         /* Calculate checksum */
@@ -71,26 +73,39 @@ int main(int argc, char *argv[])
             checksum = (checksum>>16) + (checksum&0xFFFF);
         checksum = ~checksum;
 
-        fputc(0x45, wp); /* IP version 4, header 5 words (20 bytes) */
-        fputc(0x00, wp); /* ToS */
-        fputc(packet_length>>8, wp); /* Total packet length */
-        fputc(packet_length&0xFF, wp);
-        fputc(0x00, wp); /* Identification used mainly for fragmentation */
-        fputc(0x00, wp);
-        fputc(0x00, wp); /* Flags and fragment offset */
-        fputc(0x00, wp);
-        fputc(0x40, wp); /* Time to Live (64 hops) */
-        fputc(0x11, wp); /* UDP Protocol */
-        fputc(checksum>>8, wp); /* Calculated checksum */
-        fputc(checksum&0xFF, wp);
-        for(i=0;i<16;i++) /* Source and destination addresses, UDP header */
-            fputc(apuh[i], wp);
-        packet_length -= 28; /* Subtract IP and UDP headers */
-        for(i=0;i<packet_length;i++) /* Put rest of data in file */
-            fputc(fgetc(rp), wp);
+        ip_header[0] = 0x45; /* IP version 4, header 5 words (20 bytes) */
+        ip_header[1] = 0x00; /* ToS */
+        ip_header[2] = packet_length>>8; /* Total packet length */
+        ip_header[3] = packet_length&0xFF;
+        ip_header[4] = 0x00; /* Identification used mainly for fragmentation */
+        ip_header[5] = 0x00;
+        ip_header[6] = 0x00; /* Flags and fragment offset */
+        ip_header[7] = 0x00;
+        ip_header[8] = 0x40; /* Time to Live (64 hops) */
+        ip_header[9] = 0x11; /* UDP Protocol */
+        ip_header[10] = checksum>>8; /* Calculated checksum */
+        ip_header[11] = checksum&0xFF;
+        for(i=0;i<8;i++) /* Source and destination addresses */
+            ip_header[12+i] = apuh[i];
+
+        /* Subtract IP and UDP headers for the rest of the data */
+        data_length = packet_length > 28 ? packet_length - 28 : 0;
+        if((size_t)(end - apuh - APUH_LEN) < data_length) {
+            printf("Reached end of packet during data read, exiting\n");
+            break;
+        }
+        if(bulk_out_copy(&out, ip_header, sizeof(ip_header)) != 0
+           || bulk_out_ref(&out, &apuh[9], 8 + data_length) != 0) {
+            fprintf(stderr, "error writing ip file\n");
+            exit(3);
+        }
+        apuh += APUH_LEN + data_length;
     }
 
-    fclose(rp);
-    fclose(wp);
+    if(bulk_out_close(&out) != 0) {
+        fprintf(stderr, "error writing ip file\n");
+        exit(3);
+    }
+    bulk_in_close(&in);
     return 0;
 }
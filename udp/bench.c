@@ -0,0 +1,559 @@
+/*
+ * Throughput and latency benchmark for the UDP executable spec
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "checksum.h"
+#include "config.h"
+#include "rx.h"
+#include "tx.h"
+
+/* Upper bound for the datagrams of one case, they are cycled through so the
+ * working set resembles a stream rather than a single hot buffer
+ */
+#define BENCH_POOL_BYTES (16U << 20)
+#define BENCH_POOL_MAX 4096
+/* Individually timed operations for the latency percentiles */
+#define BENCH_SAMPLES 20000
+#define BENCH_LINE_MAX 256
+
+/* Datagram length mixes. The IMIX is the simple 7:4:1 mix of 40, 576 and
+ * 1500 byte IP packets, so the UDP datagrams are 20 bytes shorter.
+ */
+struct bench_mix {
+    const char *name;
+    size_t n;
+    const size_t *lens;
+};
+
+static const size_t mix_64[] = {64};
+static const size_t mix_512[] = {512};
+static const size_t mix_1500[] = {1500};
+static const size_t mix_9000[] = {9000};
+static const size_t mix_max[] = {IP_MAX_DGRAM_LEN};
+static const size_t mix_imix[] = {20, 20, 20, 20, 20, 20, 20,
+                                  556, 556, 556, 556, 1480};
+
+#define MIX(name, lens) {name, sizeof (lens) / sizeof (lens[0]), lens}
+static const struct bench_mix mixes[] = {
+    MIX ("64", mix_64),
+    MIX ("512", mix_512),
+    MIX ("1500", mix_1500),
+    MIX ("9000", mix_9000),
+    MIX ("65535", mix_max),
+    MIX ("imix", mix_imix),
+};
+#define MIX_COUNT (sizeof (mixes) / sizeof (mixes[0]))
+
+/* Datagrams of one case. For tx, data holds the payloads instead. */
+struct bench_pool {
+    uint8_t *data;
+    size_t *off;
+    size_t *len;
+    size_t n;
+};
+
+typedef uint64_t bench_fn (const uint8_t *dgram, size_t len, uint8_t *out);
+
+static const uint32_t addr_src = 0x0100007f;
+static const uint32_t addr_dst = 0x04030201;
+
+static uint64_t
+bench_checksum (const uint8_t *dgram, size_t len, uint8_t *out)
+{
+  (void)out;
+  return checksum_sum (dgram, len);
+}
+
+static uint64_t
+bench_checksum_scalar (const uint8_t *dgram, size_t len, uint8_t *out)
+{
+  (void)out;
+  return checksum_sum_scalar (dgram, len);
+}
+
+static uint64_t
+bench_rx (const uint8_t *dgram, size_t len, uint8_t *out)
+{
+  uint16_t out_len, port_dst, port_src;
+  uint32_t out_addr_src;
+
+  if (0 != udp_rx (false, addr_src, addr_dst, UDP_PROTO, dgram, len, out,
+                   &out_len, &port_dst, &port_src, &out_addr_src))
+    {
+      fprintf (stderr, "Datagram rejected by udp_rx\n");
+      exit (EXIT_FAILURE);
+    }
+  return out_len;
+}
+
+static uint64_t
+bench_tx (const uint8_t *dgram, size_t len, uint8_t *out)
+{
+  uint16_t out_len;
+  uint32_t out_addr_src, out_addr_dst;
+  uint8_t out_proto;
+
+  udp_tx (false, addr_src, addr_dst, 60001, 60000, dgram, len - UDP_HDR_LEN,
+          out, &out_len, &out_addr_src, &out_addr_dst, &out_proto);
+  return out[UDP_HDR_OFF_CHK];
+}
+
+/* Turn the datagram around in place by swapping its ports. The datagrams
+ * in the pool stay valid for the other operations.
+ */
+static uint64_t
+bench_rewrite (const uint8_t *dgram, size_t len, uint8_t *out)
+{
+  uint8_t *hdr = (uint8_t *)dgram;
+  uint16_t port_src, port_dst;
+
+  (void)out;
+  memcpy (&port_src, &hdr[UDP_HDR_OFF_PORT_SRC], sizeof (port_src));
+  memcpy (&port_dst, &hdr[UDP_HDR_OFF_PORT_DST], sizeof (port_dst));
+  udp_tx_rewrite (false, addr_src, addr_dst, addr_src, addr_dst, port_dst,
+                  port_src, hdr, len);
+  return hdr[UDP_HDR_OFF_CHK];
+}
+
+struct bench_op {
+    const char *name;
+    bench_fn *fn;
+};
+
+static const struct bench_op ops[] = {
+    {"checksum", bench_checksum},
+    {"checksum_scalar", bench_checksum_scalar},
+    {"rx", bench_rx},
+    {"tx", bench_tx},
+    {"rewrite", bench_rewrite},
+};
+#define OP_COUNT (sizeof (ops) / sizeof (ops[0]))
+
+/* Results of one case, all times in nanoseconds */
+struct bench_result {
+    char op[32];
+    char mix[32];
+    double dgrams_per_s;
+    double gbps;
+    double ns_per_dgram;
+    double p50, p90, p99, p999;
+};
+
+/* Results are consumed here so no operation can be optimized away */
+static volatile uint64_t bench_sink;
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Deterministic pseudo-random numbers, the same datagrams every run */
+static uint32_t
+bench_rand (uint32_t *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+/* Fill pool with datagrams of mix in a shuffled order. Datagrams are made
+ * by udp_tx so they pass udp_rx.
+ */
+static void
+pool_fill (struct bench_pool *pool, const struct bench_mix *mix)
+{
+  /* Payloads start at one of 64 offsets so they are not all the same */
+  uint8_t payload[IP_MAX_DGRAM_LEN + 64];
+  size_t avg = 0, total = 0;
+  uint32_t seed = 1;
+
+  for (size_t i = 0; i < mix->n; ++i)
+    avg += mix->lens[i];
+  avg /= mix->n;
+  pool->n = BENCH_POOL_BYTES / avg;
+  if (pool->n > BENCH_POOL_MAX)
+    pool->n = BENCH_POOL_MAX;
+  if (pool->n < mix->n)
+    pool->n = mix->n;
+  pool->off = malloc (pool->n * sizeof (*pool->off));
+  pool->len = malloc (pool->n * sizeof (*pool->len));
+  if (NULL == pool->off || NULL == pool->len)
+    {
+      fprintf (stderr, "Out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  for (size_t i = 0; i < pool->n; ++i)
+    {
+      pool->len[i] = mix->lens[i % mix->n];
+      total += pool->len[i];
+    }
+  for (size_t i = pool->n - 1; i > 0; --i)
+    {
+      size_t j = bench_rand (&seed) % (i + 1);
+      size_t t = pool->len[i];
+
+      pool->len[i] = pool->len[j];
+      pool->len[j] = t;
+    }
+  pool->data = malloc (total);
+  if (NULL == pool->data)
+    {
+      fprintf (stderr, "Out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  for (size_t i = 0; i < sizeof (payload); ++i)
+    payload[i] = bench_rand (&seed);
+  total = 0;
+  for (size_t i = 0; i < pool->n; ++i)
+    {
+      uint16_t len;
+      uint32_t out_addr_src, out_addr_dst;
+      uint8_t out_proto;
+
+      pool->off[i] = total;
+      udp_tx (false, addr_src, addr_dst, 60001, 60000,
+              &payload[i % 64], pool->len[i] - UDP_HDR_LEN,
+              &pool->data[total], &len, &out_addr_src, &out_addr_dst,
+              &out_proto);
+      total += pool->len[i];
+    }
+}
+
+static void
+pool_free (struct bench_pool *pool)
+{
+  free (pool->data);
+  free (pool->off);
+  free (pool->len);
+}
+
+static int
+cmp_double (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Cost of reading the clock, taken off the latency samples */
+static double
+timer_overhead (void)
+{
+  double t[1001];
+
+  for (size_t i = 0; i < sizeof (t) / sizeof (t[0]); ++i)
+    {
+      double start = now_ns ();
+      t[i] = now_ns () - start;
+    }
+  qsort (t, sizeof (t) / sizeof (t[0]), sizeof (t[0]), cmp_double);
+  return t[500];
+}
+
+static double
+percentile (const double *sorted, size_t n, double p)
+{
+  return sorted[(size_t)(p * (n - 1))];
+}
+
+/* Run op over the datagrams of pool for at least seconds and then time
+ * BENCH_SAMPLES single operations
+ */
+static void
+bench_case (const struct bench_op *op, const struct bench_pool *pool,
+            double seconds, double overhead, uint8_t *out,
+            struct bench_result *r)
+{
+  static double samples[BENCH_SAMPLES];
+  uint64_t sink = 0, dgrams = 0, bytes = 0;
+  double start, elapsed;
+
+  /* Warm up caches and branch predictors */
+  for (size_t i = 0; i < pool->n; ++i)
+    sink += op->fn (&pool->data[pool->off[i]], pool->len[i], out);
+  start = now_ns ();
+  do
+    {
+      for (size_t i = 0; i < pool->n; ++i)
+        {
+          sink += op->fn (&pool->data[pool->off[i]], pool->len[i], out);
+          bytes += pool->len[i];
+        }
+      dgrams += pool->n;
+      elapsed = now_ns () - start;
+    }
+  while (elapsed < seconds * 1e9);
+  for (size_t i = 0; i < BENCH_SAMPLES; ++i)
+    {
+      size_t j = i % pool->n;
+      double t = now_ns ();
+
+      sink += op->fn (&pool->data[pool->off[j]], pool->len[j], out);
+      t = now_ns () - t - overhead;
+      samples[i] = t < 0 ? 0 : t;
+    }
+  bench_sink = sink;
+  qsort (samples, BENCH_SAMPLES, sizeof (samples[0]), cmp_double);
+
+  r->dgrams_per_s = dgrams / (elapsed / 1e9);
+  r->gbps = bytes * 8 / elapsed;
+  r->ns_per_dgram = elapsed / dgrams;
+  r->p50 = percentile (samples, BENCH_SAMPLES, 0.5);
+  r->p90 = percentile (samples, BENCH_SAMPLES, 0.9);
+  r->p99 = percentile (samples, BENCH_SAMPLES, 0.99);
+  r->p999 = percentile (samples, BENCH_SAMPLES, 0.999);
+}
+
+static void
+result_write (FILE *fp, const struct bench_result *r)
+{
+  fprintf (fp, "%s %s %.0f %.3f %.1f %.0f %.0f %.0f %.0f\n", r->op, r->mix,
+           r->dgrams_per_s, r->gbps, r->ns_per_dgram, r->p50, r->p90, r->p99,
+           r->p999);
+}
+
+/* Read the results of a previous run written with --output. Returns the
+ * number of results or -1 on error.
+ */
+static int
+baseline_read (const char *path, struct bench_result *base, size_t max)
+{
+  char line[BENCH_LINE_MAX];
+  FILE *fp;
+  size_t n = 0;
+
+  fp = fopen (path, "r");
+  if (NULL == fp)
+    {
+      perror (path);
+      return -1;
+    }
+  while (n < max && NULL != fgets (line, sizeof (line), fp))
+    {
+      struct bench_result *r = &base[n];
+
+      if ('#' == line[0])
+        continue;
+      if (9 != sscanf (line, "%31s %31s %lf %lf %lf %lf %lf %lf %lf", r->op,
+                       r->mix, &r->dgrams_per_s, &r->gbps, &r->ns_per_dgram,
+                       &r->p50, &r->p90, &r->p99, &r->p999))
+        {
+          fprintf (stderr, "%s: Invalid line: %s", path, line);
+          fclose (fp);
+          return -1;
+        }
+      ++n;
+    }
+  fclose (fp);
+  return n;
+}
+
+static const struct bench_result *
+baseline_find (const struct bench_result *base, size_t n,
+               const struct bench_result *r)
+{
+  for (size_t i = 0; i < n; ++i)
+    if (0 == strcmp (base[i].op, r->op) && 0 == strcmp (base[i].mix, r->mix))
+      return &base[i];
+  return NULL;
+}
+
+void
+usage (char *name)
+{
+  fprintf (stderr,
+           "Usage:\n"
+           "\t%s [--time|-T SECONDS] [--output|-o FILE] [--baseline|-b FILE]\n"
+           "\t\t[--threshold|-t PERCENT] [OP...]\n"
+           "\nRuns the operations checksum, checksum_scalar, rx, tx and\n"
+           "rewrite, or the OPs given, over fixed datagram lengths and an\n"
+           "IMIX and prints datagrams/s, Gbps, ns/datagram and latency\n"
+           "percentiles in ns. Each case runs for SECONDS, 0.2 by default.\n"
+           "Results are written to FILE in a format that can be given as a\n"
+           "baseline to a later run, which then fails if any case got slower\n"
+           "by more than PERCENT, 10 by default\n",
+           name);
+}
+
+int
+main (int argc, char **argv)
+{
+  static struct bench_result base[OP_COUNT * MIX_COUNT * 2];
+  const char *path_out = NULL, *path_base = NULL;
+  const char *only[OP_COUNT];
+  size_t nonly = 0;
+  double seconds = 0.2, threshold = 10, overhead;
+  int nbase = 0, regressions = 0;
+  FILE *fp_out = NULL;
+  uint8_t *out;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      char *end;
+
+      if ((0 == strcmp (argv[i], "--time") || 0 == strcmp (argv[i], "-T"))
+          && i + 1 < argc)
+        {
+          seconds = strtod (argv[++i], &end);
+          if ('\0' != *end || !(seconds >= 0))
+            {
+              fprintf (stderr, "Invalid time\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--output")
+                || 0 == strcmp (argv[i], "-o")) && i + 1 < argc)
+        path_out = argv[++i];
+      else if ((0 == strcmp (argv[i], "--baseline")
+                || 0 == strcmp (argv[i], "-b")) && i + 1 < argc)
+        path_base = argv[++i];
+      else if ((0 == strcmp (argv[i], "--threshold")
+                || 0 == strcmp (argv[i], "-t")) && i + 1 < argc)
+        {
+          threshold = strtod (argv[++i], &end);
+          if ('\0' != *end || !(threshold >= 0))
+            {
+              fprintf (stderr, "Invalid threshold\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else
+        {
+          size_t j;
+
+          for (j = 0; j < OP_COUNT; ++j)
+            if (0 == strcmp (argv[i], ops[j].name))
+              break;
+          if (OP_COUNT == j || OP_COUNT == nonly)
+            {
+              fprintf (stderr, "Invalid argument\n");
+              usage (argv[0]);
+              return EXIT_FAILURE;
+            }
+          only[nonly++] = ops[j].name;
+        }
+    }
+
+  if (NULL != path_base)
+    {
+      nbase = baseline_read (path_base, base,
+                             sizeof (base) / sizeof (base[0]));
+      if (0 > nbase)
+        return EXIT_FAILURE;
+    }
+  if (NULL != path_out)
+    {
+      fp_out = fopen (path_out, "w");
+      if (NULL == fp_out)
+        {
+          perror (path_out);
+          return EXIT_FAILURE;
+        }
+      fprintf (fp_out, "# kernel %s width %zu\n", checksum_sum_kernel (),
+               udp_rx_get_width ());
+      fprintf (fp_out, "# op mix dgrams/s Gbps ns/dgram p50 p90 p99 p99.9\n");
+    }
+  out = malloc (IP_MAX_DGRAM_LEN);
+  if (NULL == out)
+    {
+      fprintf (stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+  overhead = timer_overhead ();
+
+  printf ("Checksum kernel: %s, bus width: %zu bytes\n",
+          checksum_sum_kernel (), udp_rx_get_width ());
+  printf ("%-16s %-6s %12s %8s %9s %7s %7s %7s %7s%s\n", "op", "mix",
+          "dgrams/s", "Gbps", "ns/dgram", "p50", "p90", "p99", "p99.9",
+          nbase ? "  change" : "");
+  for (size_t m = 0; m < MIX_COUNT; ++m)
+    {
+      struct bench_pool pool;
+
+      pool_fill (&pool, &mixes[m]);
+      for (size_t o = 0; o < OP_COUNT; ++o)
+        {
+          const struct bench_result *b;
+          struct bench_result r;
+          bool selected = 0 == nonly;
+
+          for (size_t i = 0; i < nonly; ++i)
+            selected |= ops[o].name == only[i];
+          if (!selected)
+            continue;
+          bench_case (&ops[o], &pool, seconds, overhead, out, &r);
+          snprintf (r.op, sizeof (r.op), "%s", ops[o].name);
+          snprintf (r.mix, sizeof (r.mix), "%s", mixes[m].name);
+          printf ("%-16s %-6s %12.0f %8.3f %9.1f %7.0f %7.0f %7.0f %7.0f",
+                  r.op, r.mix, r.dgrams_per_s, r.gbps, r.ns_per_dgram, r.p50,
+                  r.p90, r.p99, r.p999);
+          b = baseline_find (base, nbase, &r);
+          if (NULL != b)
+            {
+              double change = (r.ns_per_dgram / b->ns_per_dgram - 1) * 100;
+
+              printf ("  %+6.1f%%", change);
+              if (change > threshold)
+                {
+                  printf (" REGRESSION");
+                  ++regressions;
+                }
+            }
+          printf ("\n");
+          if (NULL != fp_out)
+            result_write (fp_out, &r);
+        }
+      pool_free (&pool);
+    }
+
+  free (out);
+  if (NULL != fp_out && 0 != fclose (fp_out))
+    {
+      perror (path_out);
+      return EXIT_FAILURE;
+    }
+  if (regressions)
+    {
+      fprintf (stderr, "%d cases slower than the baseline by more than "
+               "%.1f%%\n", regressions, threshold);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
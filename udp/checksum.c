@@ -28,34 +28,41 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <arpa/inet.h>
 #include "checksum.h"
 
-/* 32bit to accumulate carries */
-static uint32_t checksum_accum;
+/* Context behind the non-reentrant interface */
+static struct checksum_ctx checksum_global;
 
 void
-checksum_reset (void)
+checksum_ctx_reset (struct checksum_ctx *ctx)
 {
-  checksum_accum = 0;
+  ctx->accum = 0;
+  ctx->odd = false;
 }
 
 uint16_t
-checksum_get (void)
+checksum_ctx_get (const struct checksum_ctx *ctx)
 {
-  /* Add wrap-around bits */
-  return htons ((checksum_accum & 0xffff) + (checksum_accum >> 16 & 0xffff));
+  uint32_t sum;
+
+  /* Add wrap-around bits, twice since the first addition can carry again */
+  sum = (ctx->accum & 0xffff) + (ctx->accum >> 16 & 0xffff);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return htons (sum);
 }
 
 uint16_t
-checksum_get_hdr_fmt (void)
+checksum_ctx_get_hdr_fmt (const struct checksum_ctx *ctx)
 {
   uint16_t t;
 
   /* "Checksum is the 16-bit one's complement of the one's complement sum
    * of..."
    */
-  t = ~checksum_get ();
+  t = ~checksum_ctx_get (ctx);
   /* "If the computed  checksum  is zero,  it is transmitted  as all ones..."
    */
   if (0 == t)
@@ -64,15 +71,153 @@ checksum_get_hdr_fmt (void)
     return t;
 }
 
+uint16_t
+checksum_hdr_fmt_adjust (uint16_t hdr_checksum, const uint16_t *old_val,
+                         const uint16_t *new_val, size_t n)
+{
+  uint64_t sum;
+  uint16_t t;
+
+  /* ~HC is the one's complement sum of the data the checksum covers */
+  sum = (uint16_t)~ntohs (hdr_checksum);
+  for (size_t i = 0; i < n; ++i)
+    sum += (uint16_t)~ntohs (old_val[i]) + (uint32_t)ntohs (new_val[i]);
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  t = ~htons (sum);
+  /* Same rule as in checksum_ctx_get_hdr_fmt */
+  if (0 == t)
+    return 0xffff;
+  else
+    return t;
+}
+
+void
+checksum_ctx_update (struct checksum_ctx *ctx, uint16_t val)
+{
+  ctx->accum += ntohs (val);
+}
+
+void
+checksum_ctx_update32 (struct checksum_ctx *ctx, uint32_t val)
+{
+  checksum_ctx_update (ctx, val & 0xffff);
+  checksum_ctx_update (ctx, val >> 16 & 0xffff);
+}
+
+void
+checksum_ctx_update_buf (struct checksum_ctx *ctx, const uint8_t *buf,
+                         size_t len)
+{
+  ctx->accum += checksum_sum (buf, len);
+}
+
+void
+checksum_ctx_update_bytes (struct checksum_ctx *ctx, const uint8_t *buf,
+                           size_t len)
+{
+  bool odd = ctx->odd;
+
+  ctx->odd = odd != (0 != len % 2);
+  /* The previous call already added the high byte of this word as if the
+   * low byte was zero, add the low byte now.
+   */
+  if (odd && 0 != len)
+    {
+      ctx->accum += buf[0];
+      ++buf;
+      --len;
+    }
+  ctx->accum += checksum_sum (buf, len);
+}
+
+void
+checksum_ctx_update_copy (struct checksum_ctx *ctx, uint8_t *dst,
+                          const uint8_t *buf, size_t len)
+{
+  bool odd = ctx->odd;
+
+  ctx->odd = odd != (0 != len % 2);
+  /* Low byte of the word started by the previous call */
+  if (odd && 0 != len)
+    {
+      ctx->accum += buf[0];
+      *dst++ = *buf++;
+      --len;
+    }
+  ctx->accum += checksum_sum_copy (dst, buf, len);
+}
+
+uint64_t
+checksum_sum_scalar (const uint8_t *buf, size_t len)
+{
+  uint64_t sum = 0;
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    {
+      uint16_t w;
+
+      memcpy (&w, &buf[i], sizeof (w));
+      sum += ntohs (w);
+    }
+  /* last octet in an odd-length buffer, pad with zero */
+  if (i < len)
+    sum += (uint16_t)buf[i] << 8;
+
+  return sum;
+}
+
+uint64_t
+checksum_sum_copy_scalar (uint8_t *dst, const uint8_t *buf, size_t len)
+{
+  uint64_t sum = 0;
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    {
+      uint16_t w;
+
+      memcpy (&w, &buf[i], sizeof (w));
+      memcpy (&dst[i], &w, sizeof (w));
+      sum += ntohs (w);
+    }
+  /* last octet in an odd-length buffer, pad with zero */
+  if (i < len)
+    {
+      dst[i] = buf[i];
+      sum += (uint16_t)buf[i] << 8;
+    }
+
+  return sum;
+}
+
+void
+checksum_reset (void)
+{
+  checksum_ctx_reset (&checksum_global);
+}
+
+uint16_t
+checksum_get (void)
+{
+  return checksum_ctx_get (&checksum_global);
+}
+
+uint16_t
+checksum_get_hdr_fmt (void)
+{
+  return checksum_ctx_get_hdr_fmt (&checksum_global);
+}
+
 void
 checksum_update (uint16_t val)
 {
-  checksum_accum += ntohs (val);
+  checksum_ctx_update (&checksum_global, val);
 }
 
 void
 checksum_update32 (uint32_t val)
 {
-  checksum_update (val & 0xffff);
-  checksum_update (val >> 16 & 0xffff);
+  checksum_ctx_update32 (&checksum_global, val);
 }
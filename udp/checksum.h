@@ -32,7 +32,106 @@
 #ifndef CHECKSUM_H
 #define CHECKSUM_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+
+/* Checksum calculation state, owned by the caller so that any number of
+ * checksums can be calculated at once.
+ */
+struct checksum_ctx {
+    /* 32bit to accumulate carries */
+    uint32_t accum;
+    /* An odd number of bytes has been passed to checksum_ctx_update_bytes */
+    bool odd;
+};
+
+/* Reset the checksum value of ctx, should be used before each new checksum
+ * calculation begins.
+ */
+void checksum_ctx_reset (struct checksum_ctx *ctx);
+/* Update the checksum of ctx using val (network byte order) */
+void checksum_ctx_update (struct checksum_ctx *ctx, uint16_t val);
+/* Update the checksum of ctx from a 32bit value val (network byte order) */
+void checksum_ctx_update32 (struct checksum_ctx *ctx, uint32_t val);
+/* Return the current checksum of ctx in network byte order */
+uint16_t checksum_ctx_get (const struct checksum_ctx *ctx);
+/* Return the final checksum of ctx ready for use in a header, in network byte
+ * order
+ */
+uint16_t checksum_ctx_get_hdr_fmt (const struct checksum_ctx *ctx);
+/* Incrementally update hdr_checksum, a checksum in header format, for n 16bit
+ * words of the checksummed data changing from old_val to new_val, all in
+ * network byte order. Uses eqn. 3 of RFC 1624, HC' = ~(~HC + ~m + m'), so
+ * the cost does not depend on the length of the data. A zero result is
+ * transmitted as all ones like with checksum_ctx_get_hdr_fmt, which makes
+ * the result the same as that of a full recalculation.
+ */
+uint16_t checksum_hdr_fmt_adjust (uint16_t hdr_checksum,
+                                  const uint16_t *old_val,
+                                  const uint16_t *new_val, size_t n);
+
+/* Update the checksum of ctx with the 16bit words (network byte order) of
+ * buf, an odd trailing byte is padded with zero. Equivalent to calling
+ * checksum_ctx_update for each word, but uses the fastest bulk kernel.
+ */
+void checksum_ctx_update_buf (struct checksum_ctx *ctx, const uint8_t *buf,
+                              size_t len);
+
+/* Update the checksum of ctx with the next len bytes of a byte stream, the
+ * stream may be split at any point including odd offsets. Don't mix with
+ * the word based update functions after an odd number of bytes.
+ */
+void checksum_ctx_update_bytes (struct checksum_ctx *ctx, const uint8_t *buf,
+                                size_t len);
+
+/* Same as checksum_ctx_update_bytes, also copies buf to dst on the way
+ * through so that the data is only read once
+ */
+void checksum_ctx_update_copy (struct checksum_ctx *ctx, uint8_t *dst,
+                               const uint8_t *buf, size_t len);
+
+/* Add a sum returned by one of the kernels below to the checksum of ctx, for
+ * callers that run a kernel directly on an even byte offset
+ */
+static inline void
+checksum_ctx_add (struct checksum_ctx *ctx, uint64_t sum)
+{
+  ctx->accum += sum;
+}
+
+/* Bulk summing kernels. Each returns the plain sum of the 16bit words
+ * (network byte order) of buf, an odd trailing byte is padded with zero.
+ * Adding the result to a context accumulator gives the same value as
+ * checksum_ctx_update word by word, the scalar kernel being the reference.
+ */
+uint64_t checksum_sum_scalar (const uint8_t *buf, size_t len);
+#if defined(__x86_64__) || defined(__i386__)
+#define CHECKSUM_HAVE_X86 1
+uint64_t checksum_sum_sse2 (const uint8_t *buf, size_t len);
+uint64_t checksum_sum_avx2 (const uint8_t *buf, size_t len);
+#endif
+/* Fused copy and sum kernels, the same as the kernels above but also copy
+ * buf to dst, which must not overlap buf
+ */
+uint64_t checksum_sum_copy_scalar (uint8_t *dst, const uint8_t *buf,
+                                   size_t len);
+#ifdef CHECKSUM_HAVE_X86
+uint64_t checksum_sum_copy_sse2 (uint8_t *dst, const uint8_t *buf,
+                                 size_t len);
+uint64_t checksum_sum_copy_avx2 (uint8_t *dst, const uint8_t *buf,
+                                 size_t len);
+#endif
+/* Sum buf with the best kernel supported by the CPU */
+uint64_t checksum_sum (const uint8_t *buf, size_t len);
+/* Copy and sum buf with the best kernel supported by the CPU */
+uint64_t checksum_sum_copy (uint8_t *dst, const uint8_t *buf, size_t len);
+/* Name of the kernel used by checksum_sum */
+const char *checksum_sum_kernel (void);
+
+/* The functions below operate on a single process-wide context and are not
+ * reentrant.
+ */
 
 /* Reset the checksum value, should be used before each new checksum
  * calculation begins.
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include "checksum.h"
+
+/* The kernels split buf into the bytes at even offsets, which are the high
+ * bytes of the 16bit words, and those at odd offsets. Each group is summed
+ * exactly with the sum of absolute differences instruction against zero,
+ * so there is no folding and no byte swapping in the loop. The word sum is
+ * then 256 times the high byte sum plus the low byte sum.
+ */
+
+#ifdef CHECKSUM_HAVE_X86
+#include <immintrin.h>
+
+__attribute__ ((target ("sse2"))) uint64_t
+checksum_sum_sse2 (const uint8_t *buf, size_t len)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  __m128i hi = zero, lo = zero;
+  uint64_t h[2], l[2];
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *)&buf[i]);
+      __m128i b = _mm_loadu_si128 ((const __m128i *)&buf[i + 16]);
+
+      hi = _mm_add_epi64 (hi, _mm_sad_epu8 (_mm_and_si128 (a, mask), zero));
+      lo = _mm_add_epi64 (lo, _mm_sad_epu8 (_mm_srli_epi16 (a, 8), zero));
+      hi = _mm_add_epi64 (hi, _mm_sad_epu8 (_mm_and_si128 (b, mask), zero));
+      lo = _mm_add_epi64 (lo, _mm_sad_epu8 (_mm_srli_epi16 (b, 8), zero));
+    }
+  _mm_storeu_si128 ((__m128i *)h, hi);
+  _mm_storeu_si128 ((__m128i *)l, lo);
+
+  return ((h[0] + h[1]) << 8) + l[0] + l[1]
+         + checksum_sum_scalar (&buf[i], len - i);
+}
+
+__attribute__ ((target ("avx2"))) uint64_t
+checksum_sum_avx2 (const uint8_t *buf, size_t len)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i mask = _mm256_set1_epi16 (0x00ff);
+  __m256i hi = zero, lo = zero;
+  uint64_t h[4], l[4];
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64)
+    {
+      __m256i a = _mm256_loadu_si256 ((const __m256i *)&buf[i]);
+      __m256i b = _mm256_loadu_si256 ((const __m256i *)&buf[i + 32]);
+
+      hi = _mm256_add_epi64 (hi, _mm256_sad_epu8 (_mm256_and_si256 (a, mask),
+                                                  zero));
+      lo = _mm256_add_epi64 (lo, _mm256_sad_epu8 (_mm256_srli_epi16 (a, 8),
+                                                  zero));
+      hi = _mm256_add_epi64 (hi, _mm256_sad_epu8 (_mm256_and_si256 (b, mask),
+                                                  zero));
+      lo = _mm256_add_epi64 (lo, _mm256_sad_epu8 (_mm256_srli_epi16 (b, 8),
+                                                  zero));
+    }
+  _mm256_storeu_si256 ((__m256i *)h, hi);
+  _mm256_storeu_si256 ((__m256i *)l, lo);
+
+  /* The SSE2 kernel finishes off anything shorter than a full iteration */
+  return ((h[0] + h[1] + h[2] + h[3]) << 8) + l[0] + l[1] + l[2] + l[3]
+         + checksum_sum_sse2 (&buf[i], len - i);
+}
+
+__attribute__ ((target ("sse2"))) uint64_t
+checksum_sum_copy_sse2 (uint8_t *dst, const uint8_t *buf, size_t len)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  __m128i hi = zero, lo = zero;
+  uint64_t h[2], l[2];
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *)&buf[i]);
+      __m128i b = _mm_loadu_si128 ((const __m128i *)&buf[i + 16]);
+
+      _mm_storeu_si128 ((__m128i *)&dst[i], a);
+      _mm_storeu_si128 ((__m128i *)&dst[i + 16], b);
+      hi = _mm_add_epi64 (hi, _mm_sad_epu8 (_mm_and_si128 (a, mask), zero));
+      lo = _mm_add_epi64 (lo, _mm_sad_epu8 (_mm_srli_epi16 (a, 8), zero));
+      hi = _mm_add_epi64 (hi, _mm_sad_epu8 (_mm_and_si128 (b, mask), zero));
+      lo = _mm_add_epi64 (lo, _mm_sad_epu8 (_mm_srli_epi16 (b, 8), zero));
+    }
+  _mm_storeu_si128 ((__m128i *)h, hi);
+  _mm_storeu_si128 ((__m128i *)l, lo);
+
+  return ((h[0] + h[1]) << 8) + l[0] + l[1]
+         + checksum_sum_copy_scalar (&dst[i], &buf[i], len - i);
+}
+
+__attribute__ ((target ("avx2"))) uint64_t
+checksum_sum_copy_avx2 (uint8_t *dst, const uint8_t *buf, size_t len)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i mask = _mm256_set1_epi16 (0x00ff);
+  __m256i hi = zero, lo = zero;
+  uint64_t h[4], l[4];
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64)
+    {
+      __m256i a = _mm256_loadu_si256 ((const __m256i *)&buf[i]);
+      __m256i b = _mm256_loadu_si256 ((const __m256i *)&buf[i + 32]);
+
+      _mm256_storeu_si256 ((__m256i *)&dst[i], a);
+      _mm256_storeu_si256 ((__m256i *)&dst[i + 32], b);
+      hi = _mm256_add_epi64 (hi, _mm256_sad_epu8 (_mm256_and_si256 (a, mask),
+                                                  zero));
+      lo = _mm256_add_epi64 (lo, _mm256_sad_epu8 (_mm256_srli_epi16 (a, 8),
+                                                  zero));
+      hi = _mm256_add_epi64 (hi, _mm256_sad_epu8 (_mm256_and_si256 (b, mask),
+                                                  zero));
+      lo = _mm256_add_epi64 (lo, _mm256_sad_epu8 (_mm256_srli_epi16 (b, 8),
+                                                  zero));
+    }
+  _mm256_storeu_si256 ((__m256i *)h, hi);
+  _mm256_storeu_si256 ((__m256i *)l, lo);
+
+  return ((h[0] + h[1] + h[2] + h[3]) << 8) + l[0] + l[1] + l[2] + l[3]
+         + checksum_sum_copy_sse2 (&dst[i], &buf[i], len - i);
+}
+#endif /* CHECKSUM_HAVE_X86 */
+
+static uint64_t (*checksum_sum_impl) (const uint8_t *, size_t)
+  = checksum_sum_scalar;
+static uint64_t (*checksum_sum_copy_impl) (uint8_t *, const uint8_t *,
+                                           size_t) = checksum_sum_copy_scalar;
+static const char *checksum_sum_impl_name = "scalar";
+
+/* Pick the kernel before main runs, so no thread ever sees it change */
+__attribute__ ((constructor)) static void
+checksum_sum_select (void)
+{
+#ifdef CHECKSUM_HAVE_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      checksum_sum_impl = checksum_sum_avx2;
+      checksum_sum_copy_impl = checksum_sum_copy_avx2;
+      checksum_sum_impl_name = "avx2";
+    }
+  else if (__builtin_cpu_supports ("sse2"))
+    {
+      checksum_sum_impl = checksum_sum_sse2;
+      checksum_sum_copy_impl = checksum_sum_copy_sse2;
+      checksum_sum_impl_name = "sse2";
+    }
+#endif
+}
+
+uint64_t
+checksum_sum (const uint8_t *buf, size_t len)
+{
+  /* Short buffers such as single bus words are not worth the indirect
+   * call
+   */
+  if (32 > len)
+    return checksum_sum_scalar (buf, len);
+  return checksum_sum_impl (buf, len);
+}
+
+uint64_t
+checksum_sum_copy (uint8_t *dst, const uint8_t *buf, size_t len)
+{
+  if (32 > len)
+    return checksum_sum_copy_scalar (dst, buf, len);
+  return checksum_sum_copy_impl (dst, buf, len);
+}
+
+const char *
+checksum_sum_kernel (void)
+{
+  return checksum_sum_impl_name;
+}
@@ -46,8 +46,23 @@
 #define UDP_HDR_OFF_LEN 4
 #define UDP_HDR_OFF_CHK 6
 #define UDP_PROTO 17
+/* UDP-Lite (RFC 3828), the length field holds the checksum coverage */
+#define UDPLITE_PROTO 136
 
 /* Datapath configuration options */
+/* Bus widths in bytes supported by the receive datapath, powers of two */
+#define UDP_DATA_WIDTH_MIN 4
+#define UDP_DATA_WIDTH_MAX 64
+/* Default bus width, can be set at build time (make WIDTH=32) and changed at
+ * run time
+ */
+#ifndef UDP_DATA_WIDTH_BYTES
 #define UDP_DATA_WIDTH_BYTES 8
+#endif
+#if UDP_DATA_WIDTH_BYTES < UDP_DATA_WIDTH_MIN \
+    || UDP_DATA_WIDTH_BYTES > UDP_DATA_WIDTH_MAX \
+    || 0 != (UDP_DATA_WIDTH_BYTES & (UDP_DATA_WIDTH_BYTES - 1))
+#error "UDP_DATA_WIDTH_BYTES must be a power of two from 4 to 64"
+#endif
 
 #endif /* CONFIG_H */
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include "demux.h"
+#include "record.h"
+
+struct demux *
+demux_create (void)
+{
+  struct demux *d;
+
+  /* Zeroed entries are DEMUX_SINK_UNBOUND */
+  d = calloc (1, sizeof (*d));
+  if (NULL == d)
+    return NULL;
+  d->dflt.type = DEMUX_SINK_DROP;
+
+  return d;
+}
+
+void
+demux_destroy (struct demux *d)
+{
+  free (d);
+}
+
+int
+demux_bind (struct demux *d, int port, const struct demux_sink *sink)
+{
+  if (DEMUX_DEFAULT == port)
+    {
+      d->dflt = *sink;
+      /* There is nothing to fall back to */
+      if (DEMUX_SINK_UNBOUND == d->dflt.type)
+        d->dflt.type = DEMUX_SINK_DROP;
+      return 0;
+    }
+  if (0 > port || DEMUX_PORTS <= port)
+    return -1;
+  d->ports[port] = *sink;
+
+  return 0;
+}
+
+/* Write a stream output record to fd, the same framing as record_write */
+static int
+demux_write_fd (int fd, uint8_t status, const uint8_t *rec, size_t len)
+{
+  uint32_t frame_len = htonl (1 + len);
+  struct iovec iov[3];
+  struct iovec *v = iov;
+  int cnt = 3;
+
+  iov[0].iov_base = &frame_len;
+  iov[0].iov_len = sizeof (frame_len);
+  iov[1].iov_base = &status;
+  iov[1].iov_len = 1;
+  iov[2].iov_base = (void *)rec;
+  iov[2].iov_len = len;
+  while (0 < cnt)
+    {
+      ssize_t n = writev (fd, v, cnt);
+
+      if (0 > n)
+        {
+          if (EINTR == errno)
+            continue;
+          return -1;
+        }
+      /* Skip what has been written, partially written entries are
+       * adjusted
+       */
+      while (0 < cnt && (size_t)n >= v->iov_len)
+        {
+          n -= v->iov_len;
+          ++v;
+          --cnt;
+        }
+      if (0 < cnt)
+        {
+          v->iov_base = (uint8_t *)v->iov_base + n;
+          v->iov_len -= n;
+        }
+    }
+
+  return 0;
+}
+
+int
+demux_dispatch (const struct demux *d, uint8_t status, const uint8_t *rec,
+                size_t len)
+{
+  const struct demux_sink *sink = &d->dflt;
+
+  if (RECORD_STATUS_OK == status && RECORD_RX_OUT_HDR_LEN <= len)
+    {
+      uint16_t port_dst;
+
+      memcpy (&port_dst, &rec[6], sizeof (port_dst));
+      if (DEMUX_SINK_UNBOUND != d->ports[ntohs (port_dst)].type)
+        sink = &d->ports[ntohs (port_dst)];
+    }
+  switch (sink->type)
+    {
+    case DEMUX_SINK_FILE:
+      return record_write (sink->fp, status, rec, len);
+    case DEMUX_SINK_FD:
+      return demux_write_fd (sink->fd, status, rec, len);
+    case DEMUX_SINK_CALLBACK:
+      return sink->fn (sink->ctx, status, rec, len);
+    default:
+      return 0;
+    }
+}
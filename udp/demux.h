@@ -0,0 +1,98 @@
+/*
+ * Destination port demultiplexer for RX output records
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef DEMUX_H
+#define DEMUX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Number of entries in the port table */
+#define DEMUX_PORTS 65536
+/* Port argument of demux_bind for the default sink */
+#define DEMUX_DEFAULT (-1)
+
+/* Callback sink, gets the status byte and output record of a stream output
+ * record. Returns 0 on success.
+ */
+typedef int demux_fn (void *ctx, uint8_t status, const uint8_t *rec,
+                      size_t len);
+
+enum demux_sink_type {
+    /* Use the default sink, the state of every port until bound */
+    DEMUX_SINK_UNBOUND = 0,
+    /* Discard the records */
+    DEMUX_SINK_DROP,
+    /* Write stream output records to a FILE */
+    DEMUX_SINK_FILE,
+    /* Write stream output records to a file descriptor */
+    DEMUX_SINK_FD,
+    /* Call fn */
+    DEMUX_SINK_CALLBACK,
+};
+
+struct demux_sink {
+    enum demux_sink_type type;
+    FILE *fp;
+    int fd;
+    demux_fn *fn;
+    void *ctx;
+};
+
+/* Direct lookup table of sinks by destination port */
+struct demux {
+    struct demux_sink dflt;
+    struct demux_sink ports[DEMUX_PORTS];
+};
+
+/* Create a demultiplexer with every port unbound and a default sink that
+ * drops records. Returns NULL on failure.
+ */
+struct demux *demux_create (void);
+/* Free d, the FILEs and file descriptors of the sinks are left open */
+void demux_destroy (struct demux *d);
+/* Bind port (host byte order) or DEMUX_DEFAULT to a copy of sink.
+ *
+ * Returns 0 on success and -1 if port is out of range
+ */
+int demux_bind (struct demux *d, int port, const struct demux_sink *sink);
+/* Pass one stream output record of the rx path to the sink of its
+ * destination port. Error records, which carry no port, go to the default
+ * sink.
+ *
+ * Returns 0 on success
+ */
+int demux_dispatch (const struct demux *d, uint8_t status, const uint8_t *rec,
+                    size_t len);
+
+#endif /* DEMUX_H */
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "engine.h"
+#include "record.h"
+
+/* Jobs claimed by a worker at once, keeps lock traffic low for small
+ * records
+ */
+#define ENGINE_CHUNK 64
+
+struct engine {
+    record_fn *fn;
+    pthread_mutex_t lock;
+    /* Signalled when a batch is posted or the engine is destroyed */
+    pthread_cond_t work;
+    /* Signalled when the last job of a batch completes */
+    pthread_cond_t done;
+    pthread_t *threads;
+    unsigned nthreads;
+    /* Current batch, protected by lock */
+    struct engine_job *jobs;
+    size_t n;
+    size_t next;
+    size_t finished;
+    bool quit;
+};
+
+/* Claim and process chunks of the current batch until none are left. Called
+ * and returns with e->lock held.
+ */
+static void
+engine_work (struct engine *e)
+{
+  while (e->next < e->n)
+    {
+      struct engine_job *jobs = e->jobs;
+      size_t first = e->next;
+      size_t last = e->n - first < ENGINE_CHUNK ? e->n : first + ENGINE_CHUNK;
+
+      e->next = last;
+      pthread_mutex_unlock (&e->lock);
+      for (size_t i = first; i < last; ++i)
+        /* Debug printing from several threads would be interleaved */
+        jobs[i].status = e->fn (false, jobs[i].in, jobs[i].in_len,
+                                jobs[i].out, &jobs[i].out_len);
+      pthread_mutex_lock (&e->lock);
+      e->finished += last - first;
+      if (e->finished == e->n)
+        pthread_cond_signal (&e->done);
+    }
+}
+
+static void *
+engine_worker (void *arg)
+{
+  struct engine *e = arg;
+
+  pthread_mutex_lock (&e->lock);
+  for (;;)
+    {
+      while (!e->quit && e->next >= e->n)
+        pthread_cond_wait (&e->work, &e->lock);
+      if (e->quit)
+        break;
+      engine_work (e);
+    }
+  pthread_mutex_unlock (&e->lock);
+
+  return NULL;
+}
+
+struct engine *
+engine_create (record_fn *fn, unsigned nthreads)
+{
+  struct engine *e;
+
+  if (0 == nthreads)
+    return NULL;
+  e = calloc (1, sizeof (*e));
+  if (NULL == e)
+    return NULL;
+  e->fn = fn;
+  pthread_mutex_init (&e->lock, NULL);
+  pthread_cond_init (&e->work, NULL);
+  pthread_cond_init (&e->done, NULL);
+  e->threads = calloc (nthreads, sizeof (*e->threads));
+  if (NULL == e->threads)
+    {
+      engine_destroy (e);
+      return NULL;
+    }
+  /* The caller of engine_run is the remaining worker */
+  for (; e->nthreads < nthreads - 1; ++e->nthreads)
+    if (0 != pthread_create (&e->threads[e->nthreads], NULL, engine_worker,
+                             e))
+      {
+        engine_destroy (e);
+        return NULL;
+      }
+
+  return e;
+}
+
+void
+engine_run (struct engine *e, struct engine_job *jobs, size_t n)
+{
+  pthread_mutex_lock (&e->lock);
+  e->jobs = jobs;
+  e->n = n;
+  e->next = 0;
+  e->finished = 0;
+  pthread_cond_broadcast (&e->work);
+  engine_work (e);
+  while (e->finished < e->n)
+    pthread_cond_wait (&e->done, &e->lock);
+  pthread_mutex_unlock (&e->lock);
+}
+
+void
+engine_destroy (struct engine *e)
+{
+  pthread_mutex_lock (&e->lock);
+  e->quit = true;
+  pthread_cond_broadcast (&e->work);
+  pthread_mutex_unlock (&e->lock);
+  for (unsigned i = 0; i < e->nthreads; ++i)
+    pthread_join (e->threads[i], NULL);
+  pthread_cond_destroy (&e->done);
+  pthread_cond_destroy (&e->work);
+  pthread_mutex_destroy (&e->lock);
+  free (e->threads);
+  free (e);
+}
@@ -0,0 +1,71 @@
+/*
+ * Multi-threaded batch engine for stream records
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "record.h"
+
+/* One record of a batch */
+struct engine_job {
+    /* Input record and its length */
+    const uint8_t *in;
+    size_t in_len;
+    /* Output for the output record, must hold RECORD_OUT_MAX (in_len) bytes
+     */
+    uint8_t *out;
+    /* Set by engine_run */
+    size_t out_len;
+    uint8_t status;
+};
+
+struct engine;
+
+/* Create an engine with nthreads workers in total, the thread calling
+ * engine_run counts as one of them.
+ *
+ * fn: Processing function for each record, e.g. record_rx
+ *
+ * Returns NULL on failure
+ */
+struct engine *engine_create (record_fn *fn, unsigned nthreads);
+/* Process n jobs, spread over all workers. Returns once every job is done,
+ * so results are in the order of the jobs array regardless of which worker
+ * handled them.
+ */
+void engine_run (struct engine *e, struct engine_job *jobs, size_t n);
+/* Stop the workers and free e */
+void engine_destroy (struct engine *e);
+
+#endif /* ENGINE_H */
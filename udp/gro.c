@@ -0,0 +1,141 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "gro.h"
+#include "record.h"
+
+void
+gro_init (struct gro *g, size_t limit)
+{
+  g->limit = limit;
+  g->count = 0;
+  g->len = 0;
+  g->seg_len = 0;
+}
+
+int
+gro_flush (struct gro *g, FILE *fp)
+{
+  int ret;
+
+  if (0 == g->count)
+    return 0;
+  ret = record_write (fp, RECORD_STATUS_OK, g->buf, GRO_HDR_LEN + g->len);
+  g->count = 0;
+  g->len = 0;
+
+  return ret;
+}
+
+int
+gro_add (struct gro *g, FILE *fp, uint8_t status, const uint8_t *rec,
+         size_t len)
+{
+  const uint8_t *payload;
+  size_t payload_len;
+  uint16_t seg_len;
+
+  if (RECORD_STATUS_OK != status || RECORD_RX_OUT_HDR_LEN > len)
+    {
+      if (0 != gro_flush (g, fp))
+        return -1;
+      return record_write (fp, status, rec, len);
+    }
+  payload = &rec[RECORD_RX_OUT_HDR_LEN];
+  payload_len = len - RECORD_RX_OUT_HDR_LEN;
+
+  /* Same flow, non-empty and no longer than the segments so far. The run
+   * is still open, it is flushed as soon as a shorter payload ends it.
+   */
+  if (0 != g->count && 0 != payload_len && payload_len <= g->seg_len
+      && GRO_MAX_LEN - g->len >= payload_len
+      && 0 == memcmp (g->buf, rec, RECORD_RX_OUT_HDR_LEN))
+    {
+      memcpy (&g->buf[GRO_HDR_LEN + g->len], payload, payload_len);
+      g->len += payload_len;
+      ++g->count;
+      if (payload_len < g->seg_len || g->limit == g->count)
+        return gro_flush (g, fp);
+      return 0;
+    }
+
+  /* Start a new run */
+  if (0 != gro_flush (g, fp))
+    return -1;
+  memcpy (g->buf, rec, RECORD_RX_OUT_HDR_LEN);
+  g->seg_len = payload_len;
+  seg_len = htons (g->seg_len);
+  memcpy (&g->buf[RECORD_RX_OUT_HDR_LEN], &seg_len, sizeof (seg_len));
+  memcpy (&g->buf[GRO_HDR_LEN], payload, payload_len);
+  g->len = payload_len;
+  g->count = 1;
+  /* Empty payloads cannot be told apart once merged */
+  if (0 == payload_len || g->limit == g->count)
+    return gro_flush (g, fp);
+
+  return 0;
+}
+
+size_t
+gro_count (const uint8_t *rec, size_t len)
+{
+  uint16_t seg_len;
+
+  if (GRO_HDR_LEN > len)
+    return 0;
+  memcpy (&seg_len, &rec[RECORD_RX_OUT_HDR_LEN], sizeof (seg_len));
+  seg_len = ntohs (seg_len);
+  len -= GRO_HDR_LEN;
+  if (0 == seg_len)
+    return 0 == len ? 1 : 0;
+
+  return (len + seg_len - 1) / seg_len;
+}
+
+size_t
+gro_segment (const uint8_t *rec, size_t len, size_t i, uint8_t *out)
+{
+  uint16_t seg_len;
+  size_t off, n;
+
+  memcpy (&seg_len, &rec[RECORD_RX_OUT_HDR_LEN], sizeof (seg_len));
+  seg_len = ntohs (seg_len);
+  off = GRO_HDR_LEN + i * seg_len;
+  n = len - off < seg_len ? len - off : seg_len;
+  memcpy (out, rec, RECORD_RX_OUT_HDR_LEN);
+  memcpy (&out[RECORD_RX_OUT_HDR_LEN], &rec[off], n);
+
+  return RECORD_RX_OUT_HDR_LEN + n;
+}
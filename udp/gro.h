@@ -0,0 +1,101 @@
+/*
+ * Coalescing of same-flow RX output records
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef GRO_H
+#define GRO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "record.h"
+
+/* Coalesced RX output record (all integer types are network byte order):
+ * Source address
+ * Source port
+ * Destination port
+ * Segment size
+ * Data payloads of the datagrams
+ *
+ * Every payload but the last one is segment size bytes long, the last one
+ * may be shorter. A record of a single empty payload has a segment size of
+ * zero.
+ */
+#define GRO_HDR_LEN (RECORD_RX_OUT_HDR_LEN + 2U)
+/* Upper bound for the payload bytes of a coalesced record, so that it fits
+ * RECORD_MAX_LEN with the status byte of a stream output record
+ */
+#define GRO_MAX_LEN (RECORD_MAX_LEN - 1 - GRO_HDR_LEN)
+
+/* Coalescing stage, merges consecutive valid RX output records of the same
+ * flow (source address, source port and destination port) as long as their
+ * payloads are the same length. A shorter payload ends the run, just like a
+ * different flow, an error record or reaching the limit.
+ */
+struct gro {
+    /* Maximum number of datagrams in a record */
+    size_t limit;
+    /* Datagrams and payload bytes in buf, nothing is pending if count is 0 */
+    size_t count;
+    size_t len;
+    uint16_t seg_len;
+    uint8_t buf[GRO_HDR_LEN + GRO_MAX_LEN];
+};
+
+/* Set up g to merge up to limit datagrams per record, limit > 0 */
+void gro_init (struct gro *g, size_t limit);
+/* Pass one stream output record of the rx path through g. The coalesced
+ * records that are complete are written to fp as stream output records,
+ * error records are passed on as they are.
+ *
+ * Returns 0 on success
+ */
+int gro_add (struct gro *g, FILE *fp, uint8_t status, const uint8_t *rec,
+             size_t len);
+/* Write the pending record, at the end of the stream. Returns 0 on success
+ */
+int gro_flush (struct gro *g, FILE *fp);
+
+/* Number of datagrams in the coalesced record rec of len bytes, 0 if it is
+ * malformed
+ */
+size_t gro_count (const uint8_t *rec, size_t len);
+/* Rebuild the RX output record of datagram i of the coalesced record rec,
+ * i < gro_count (rec, len).
+ *
+ * out: Output for the RX output record, RECORD_RX_OUT_HDR_LEN plus the
+ *      segment size bytes
+ *
+ * Returns the length of the RX output record
+ */
+size_t gro_segment (const uint8_t *rec, size_t len, size_t i, uint8_t *out);
+
+#endif /* GRO_H */
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "config.h"
+#include "model.h"
+#include "rx.h"
+
+int
+model_init (struct model *m, size_t width, unsigned gap)
+{
+  struct udp_rx_state st;
+
+  if (0 != udp_rx_init (&st, width))
+    return -1;
+  memset (m, 0, sizeof (*m));
+  m->width = width;
+  m->gap = gap;
+  m->latency_min = UINT64_MAX;
+
+  return 0;
+}
+
+int
+model_dgram (struct model *m, uint8_t proto, uint32_t addr_src,
+             uint32_t addr_dst, const uint8_t *dgram, size_t dgram_len)
+{
+  struct udp_rx_state st;
+  uint8_t out[UDP_DATA_WIDTH_MAX];
+  uint64_t start, latency;
+  int error;
+
+  if ((UDP_PROTO != proto && UDPLITE_PROTO != proto)
+      || UDP_HDR_LEN > dgram_len
+      || IP_MAX_DGRAM_LEN < dgram_len)
+    {
+      ++m->skipped;
+      return RX_ERROR_NOT_UDP;
+    }
+
+  udp_rx_init (&st, m->width);
+  if (UDPLITE_PROTO == proto)
+    udp_rx_start_lite (&st, addr_src, addr_dst, dgram_len);
+  else
+    udp_rx_start (&st, addr_src, addr_dst, dgram_len);
+  for (size_t i = 0; i < dgram_len; i += m->width)
+    {
+      size_t len = dgram_len - i < m->width ? dgram_len - i : m->width;
+      size_t out_len;
+
+      udp_rx_pipeline (&st, &dgram[i], len, out, &out_len);
+      if (0 == out_len)
+        ++m->header_beats;
+      if (m->width != len)
+        ++m->partial_beats;
+    }
+  error = udp_rx_finish (&st);
+
+  /* The verdict of the previous datagram is due in the cycle this one
+   * starts, unless the source waits
+   */
+  start = m->next_start;
+  if (0 != m->dgrams && m->cycles > start)
+    ++m->overlap_cycles;
+  /* Transfers take st.beats cycles, the verdict one more */
+  latency = st.beats + 1;
+  m->cycles = start + latency;
+  m->next_start = start + st.beats + m->gap;
+  ++m->verdict_cycles;
+
+  ++m->dgrams;
+  m->bytes += dgram_len;
+  m->wire_bytes += dgram_len + MODEL_WIRE_OVERHEAD;
+  m->beats += st.beats;
+  m->latency_sum += latency;
+  if (latency < m->latency_min)
+    m->latency_min = latency;
+  if (latency > m->latency_max)
+    m->latency_max = latency;
+
+  return error;
+}
+
+void
+model_report (const struct model *m, FILE *fp, double clock_mhz,
+              double line_gbps)
+{
+  double ns = 1e3 / clock_mhz, seconds, line_seconds;
+
+  fprintf (fp, "Bus width: %zu bytes\n", m->width);
+  fprintf (fp, "Clock: %.3f MHz\n", clock_mhz);
+  fprintf (fp, "Gap: %u cycles\n", m->gap);
+  fprintf (fp, "Datagrams: %" PRIu64 " (%" PRIu64 " skipped)\n", m->dgrams,
+           m->skipped);
+  fprintf (fp, "Bytes: %" PRIu64 "\n", m->bytes);
+  if (0 == m->dgrams)
+    return;
+  fprintf (fp, "Bus transfers: %" PRIu64 " (%" PRIu64 " header only, %"
+           PRIu64 " partial)\n", m->beats, m->header_beats,
+           m->partial_beats);
+  fprintf (fp, "Bus efficiency: %.1f%%\n",
+           100.0 * m->bytes / (m->beats * m->width));
+  fprintf (fp, "Cycles: %" PRIu64 " (%" PRIu64 " verdict, %" PRIu64
+           " overlapped)\n", m->cycles, m->verdict_cycles,
+           m->overlap_cycles);
+  fprintf (fp, "Cycles per datagram: %.2f\n", (double)m->cycles / m->dgrams);
+  fprintf (fp, "Latency: %" PRIu64 "/%.2f/%" PRIu64 " cycles min/avg/max, "
+           "%.1f/%.1f/%.1f ns\n", m->latency_min,
+           (double)m->latency_sum / m->dgrams, m->latency_max,
+           m->latency_min * ns, m->latency_sum * ns / m->dgrams,
+           m->latency_max * ns);
+
+  seconds = m->cycles / (clock_mhz * 1e6);
+  fprintf (fp, "Throughput: %.3f Gbps, %.0f datagrams/s\n",
+           m->bytes * 8 / seconds / 1e9, m->dgrams / seconds);
+  /* Clock at which the datapath keeps up with the line */
+  line_seconds = m->wire_bytes * 8 / (line_gbps * 1e9);
+  fprintf (fp, "Line rate: %.3f Gbps needs %.3f MHz, headroom %+.1f%%\n",
+           line_gbps, m->cycles / line_seconds / 1e6,
+           (clock_mhz * 1e6 / (m->cycles / line_seconds) - 1) * 100);
+}
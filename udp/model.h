@@ -0,0 +1,103 @@
+/*
+ * Cycle model of the RX datapath bus
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Bytes a UDP datagram of an IPv4 packet adds on an Ethernet line: IPv4
+ * header without options, Ethernet header, FCS, preamble and inter-frame gap
+ */
+#define MODEL_WIRE_OVERHEAD (20U + 14U + 4U + 8U + 12U)
+
+/* Clock cycle model of the RX datapath, see model_dgram for the timing
+ * rules. All counts are for the datagrams run through the model so far.
+ */
+struct model {
+    /* Bus width in bytes */
+    size_t width;
+    /* Idle cycles the source inserts between datagrams */
+    unsigned gap;
+    uint64_t dgrams;
+    /* Datagrams not fed to the datapath, not UDP or malformed */
+    uint64_t skipped;
+    /* UDP datagram bytes */
+    uint64_t bytes;
+    /* Bytes on an Ethernet line, MODEL_WIRE_OVERHEAD included */
+    uint64_t wire_bytes;
+    /* Bus transfers, those carrying only header bytes and partial ones */
+    uint64_t beats;
+    uint64_t header_beats;
+    uint64_t partial_beats;
+    /* Cycles spent on checksum verdicts and those hidden by the first
+     * transfer of the next datagram
+     */
+    uint64_t verdict_cycles;
+    uint64_t overlap_cycles;
+    /* Cycle of the last verdict, the total run time */
+    uint64_t cycles;
+    /* Latency from the first transfer to the verdict in cycles */
+    uint64_t latency_min;
+    uint64_t latency_max;
+    uint64_t latency_sum;
+    /* First cycle the bus is free for the next datagram */
+    uint64_t next_start;
+};
+
+/* Set up m for a bus of width bytes, see udp_rx_init.
+ *
+ * Returns 0 on success and -1 for unsupported widths
+ */
+int model_init (struct model *m, size_t width, unsigned gap);
+/* Run one IP data section through udp_rx_pipeline and account for its
+ * cycles. Datagrams arrive back to back and take one cycle per bus
+ * transfer, the header transfers included. The last transfer of a datagram
+ * is partial unless its length is a multiple of the width, the next
+ * datagram always starts on a new transfer. The checksum verdict takes
+ * one more cycle, which overlaps the first transfer of the next datagram
+ * unless there is a gap.
+ *
+ * Returns the RX_ERROR_* bits of the datagram, RX_ERROR_NOT_UDP for skipped
+ * ones
+ */
+int model_dgram (struct model *m, uint8_t proto, uint32_t addr_src,
+                 uint32_t addr_dst, const uint8_t *dgram, size_t dgram_len);
+/* Print the cycle counts and the throughput for a clock of clock_mhz to fp,
+ * with the clock needed for line_gbps of Ethernet and the headroom over it
+ */
+void model_report (const struct model *m, FILE *fp, double clock_mhz,
+                   double line_gbps);
+
+#endif /* MODEL_H */
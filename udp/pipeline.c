@@ -0,0 +1,398 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "pipeline.h"
+#include "record.h"
+
+/* Entries of the rings from the reader to each worker and from each worker
+ * to the writer, a power of two
+ */
+#define PIPELINE_RING_SIZE 1024
+/* Buffer memory of each size class and the most buffers in one class */
+#define PIPELINE_CLASS_BYTES (8U << 20)
+#define PIPELINE_CLASS_BUFS_MAX 4096
+/* Keeps the ring indices of different threads in separate cache lines */
+#define PIPELINE_CACHE_LINE 64
+
+/* Longest input record of each size class: small datagrams, Ethernet
+ * frames, jumbo frames and the rest
+ */
+static const size_t pipeline_class_len[] = {
+    256, 2048, 16384, RECORD_MAX_LEN,
+};
+#define PIPELINE_CLASSES \
+  (sizeof (pipeline_class_len) / sizeof (pipeline_class_len[0]))
+
+/* Single-producer, single-consumer ring of pointers. Each index is only
+ * written by one side, the release and acquire pairs make the slot
+ * contents visible before the index that publishes them.
+ */
+struct pipeline_ring {
+    /* Next slot to pop, written by the consumer */
+    size_t head __attribute__ ((aligned (PIPELINE_CACHE_LINE)));
+    /* Next slot to push, written by the producer */
+    size_t tail __attribute__ ((aligned (PIPELINE_CACHE_LINE)));
+    size_t mask __attribute__ ((aligned (PIPELINE_CACHE_LINE)));
+    void **slots;
+};
+
+/* Pooled record buffer, the input record and room for the output record
+ * follow in the same allocation
+ */
+struct pipeline_buf {
+    unsigned cls;
+    size_t in_len;
+    size_t out_len;
+    uint8_t status;
+    uint8_t *in;
+    uint8_t *out;
+};
+
+/* Preallocated buffers of one size, free ones are passed back from the
+ * writer to the reader in a ring
+ */
+struct pipeline_class {
+    uint8_t *slab;
+    struct pipeline_ring free;
+};
+
+struct pipeline {
+    record_fn *fn;
+    FILE *fp_in;
+    unsigned nworkers;
+    struct pipeline_class classes[PIPELINE_CLASSES];
+    /* One of each per worker */
+    struct pipeline_ring *in;
+    struct pipeline_ring *out;
+    /* Set by the reader before the end marker */
+    bool truncated;
+};
+
+/* Marks the end of the records in every ring */
+static struct pipeline_buf pipeline_end;
+
+static int
+ring_init (struct pipeline_ring *r, size_t size)
+{
+  size_t n = 1;
+
+  while (n < size)
+    n <<= 1;
+  r->head = 0;
+  r->tail = 0;
+  r->mask = n - 1;
+  r->slots = malloc (n * sizeof (*r->slots));
+
+  return NULL == r->slots ? -1 : 0;
+}
+
+static bool
+ring_push (struct pipeline_ring *r, void *p)
+{
+  size_t tail = __atomic_load_n (&r->tail, __ATOMIC_RELAXED);
+
+  if (tail - __atomic_load_n (&r->head, __ATOMIC_ACQUIRE) > r->mask)
+    return false;
+  r->slots[tail & r->mask] = p;
+  __atomic_store_n (&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+static bool
+ring_pop (struct pipeline_ring *r, void **p)
+{
+  size_t head = __atomic_load_n (&r->head, __ATOMIC_RELAXED);
+
+  if (head == __atomic_load_n (&r->tail, __ATOMIC_ACQUIRE))
+    return false;
+  *p = r->slots[head & r->mask];
+  __atomic_store_n (&r->head, head + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+/* Back off while a ring is full or empty, yielding first and sleeping once
+ * the other side looks idle
+ */
+static void
+ring_wait (unsigned *spins)
+{
+  struct timespec ts = {0, 20000};
+
+  if (++*spins < 256)
+    sched_yield ();
+  else
+    nanosleep (&ts, NULL);
+}
+
+static void
+ring_push_wait (struct pipeline_ring *r, void *p)
+{
+  unsigned spins = 0;
+
+  while (!ring_push (r, p))
+    ring_wait (&spins);
+}
+
+static void *
+ring_pop_wait (struct pipeline_ring *r)
+{
+  unsigned spins = 0;
+  void *p;
+
+  while (!ring_pop (r, &p))
+    ring_wait (&spins);
+
+  return p;
+}
+
+/* Zeroed memory aligned to a cache line, NULL on failure */
+static void *
+pipeline_alloc (size_t size)
+{
+  void *p;
+
+  if (0 != posix_memalign (&p, PIPELINE_CACHE_LINE, size))
+    return NULL;
+  memset (p, 0, size);
+
+  return p;
+}
+
+/* Bytes taken by a buffer of class cls in its slab */
+static size_t
+pipeline_stride (unsigned cls)
+{
+  size_t len = pipeline_class_len[cls];
+  size_t stride = sizeof (struct pipeline_buf) + len + RECORD_OUT_MAX (len);
+
+  return (stride + PIPELINE_CACHE_LINE - 1)
+         / PIPELINE_CACHE_LINE * PIPELINE_CACHE_LINE;
+}
+
+/* Number of buffers of class cls, at least one of the largest class */
+static size_t
+pipeline_class_bufs (unsigned cls)
+{
+  size_t n = PIPELINE_CLASS_BYTES / pipeline_stride (cls);
+
+  return PIPELINE_CLASS_BUFS_MAX < n ? PIPELINE_CLASS_BUFS_MAX : n;
+}
+
+static int
+pipeline_class_init (struct pipeline_class *c, unsigned cls)
+{
+  size_t n = pipeline_class_bufs (cls), stride = pipeline_stride (cls);
+
+  c->slab = pipeline_alloc (n * stride);
+  if (NULL == c->slab || 0 != ring_init (&c->free, n))
+    return -1;
+  for (size_t i = 0; i < n; ++i)
+    {
+      struct pipeline_buf *b = (struct pipeline_buf *)&c->slab[i * stride];
+
+      b->cls = cls;
+      b->in = (uint8_t *)&b[1];
+      b->out = b->in + pipeline_class_len[cls];
+      ring_push (&c->free, b);
+    }
+
+  return 0;
+}
+
+static void *
+pipeline_reader (void *arg)
+{
+  struct pipeline *p = arg;
+  size_t k = 0;
+
+  for (;; ++k)
+    {
+      struct pipeline_buf *b;
+      size_t len, n;
+      unsigned cls;
+      int ret;
+
+      ret = record_read_len (p->fp_in, &len);
+      if (0 != ret)
+        {
+          p->truncated = 0 > ret;
+          break;
+        }
+      /* Over-long records are only read as far as the largest class goes
+       * and reported as malformed by the worker
+       */
+      n = RECORD_MAX_LEN < len ? RECORD_MAX_LEN : len;
+      for (cls = 0; pipeline_class_len[cls] < n; ++cls)
+        ;
+      b = ring_pop_wait (&p->classes[cls].free);
+      b->in_len = len;
+      if (n != fread (b->in, 1, n, p->fp_in))
+        {
+          p->truncated = true;
+          break;
+        }
+      for (size_t i = n; i < len; ++i)
+        if (EOF == fgetc (p->fp_in))
+          {
+            p->truncated = true;
+            goto out;
+          }
+      ring_push_wait (&p->in[k % p->nworkers], b);
+    }
+
+out:
+  for (unsigned i = 0; i < p->nworkers; ++i)
+    ring_push_wait (&p->in[i], &pipeline_end);
+
+  return NULL;
+}
+
+struct pipeline_worker_arg {
+    struct pipeline *p;
+    unsigned index;
+};
+
+static void *
+pipeline_worker (void *arg)
+{
+  struct pipeline_worker_arg *w = arg;
+  struct pipeline_ring *in = &w->p->in[w->index];
+  struct pipeline_ring *out = &w->p->out[w->index];
+  record_fn *fn = w->p->fn;
+  struct pipeline_buf *b;
+
+  while (&pipeline_end != (b = ring_pop_wait (in)))
+    {
+      if (RECORD_MAX_LEN < b->in_len)
+        {
+          b->status = RECORD_STATUS_MALFORMED;
+          b->out_len = 0;
+        }
+      else
+        b->status = fn (false, b->in, b->in_len, b->out, &b->out_len);
+      ring_push_wait (out, b);
+    }
+  ring_push_wait (out, &pipeline_end);
+
+  return NULL;
+}
+
+int
+pipeline_run (record_fn *fn, unsigned nworkers, FILE *fp_in,
+              pipeline_out_fn *out, void *arg)
+{
+  struct pipeline p = {.fn = fn, .fp_in = fp_in, .nworkers = nworkers};
+  struct pipeline_worker_arg *args = NULL;
+  pthread_t reader, *workers = NULL;
+  unsigned started = 0;
+  bool reading = false;
+  int ret = -1;
+
+  if (0 == nworkers)
+    return -1;
+  p.in = pipeline_alloc (nworkers * sizeof (*p.in));
+  p.out = pipeline_alloc (nworkers * sizeof (*p.out));
+  workers = calloc (nworkers, sizeof (*workers));
+  args = calloc (nworkers, sizeof (*args));
+  if (NULL == p.in || NULL == p.out || NULL == workers || NULL == args)
+    goto err;
+  for (unsigned i = 0; i < PIPELINE_CLASSES; ++i)
+    if (0 != pipeline_class_init (&p.classes[i], i))
+      goto err;
+  for (unsigned i = 0; i < nworkers; ++i)
+    if (0 != ring_init (&p.in[i], PIPELINE_RING_SIZE)
+        || 0 != ring_init (&p.out[i], PIPELINE_RING_SIZE))
+      goto err;
+  for (; started < nworkers; ++started)
+    {
+      args[started].p = &p;
+      args[started].index = started;
+      if (0 != pthread_create (&workers[started], NULL, pipeline_worker,
+                               &args[started]))
+        goto err;
+    }
+  if (0 != pthread_create (&reader, NULL, pipeline_reader, &p))
+    goto err;
+  reading = true;
+
+  /* Writer, takes the records from the workers in the order the reader
+   * handed them out
+   */
+  ret = 0;
+  for (size_t k = 0;; ++k)
+    {
+      struct pipeline_buf *b = ring_pop_wait (&p.out[k % nworkers]);
+
+      if (&pipeline_end == b)
+        break;
+      /* Keep draining after a failure so the other stages can finish */
+      if (0 == ret && 0 != out (arg, b->status, b->out, b->out_len))
+        ret = -1;
+      ring_push (&p.classes[b->cls].free, b);
+    }
+
+err:
+  if (!reading)
+    /* Let the workers that did start finish */
+    for (unsigned i = 0; i < started; ++i)
+      ring_push_wait (&p.in[i], &pipeline_end);
+  else
+    pthread_join (reader, NULL);
+  for (unsigned i = 0; i < started; ++i)
+    pthread_join (workers[i], NULL);
+  if (p.truncated)
+    ret = -1;
+  for (unsigned i = 0; i < PIPELINE_CLASSES; ++i)
+    {
+      free (p.classes[i].slab);
+      free (p.classes[i].free.slots);
+    }
+  if (NULL != p.in)
+    for (unsigned i = 0; i < nworkers; ++i)
+      {
+        free (p.in[i].slots);
+        free (p.out[i].slots);
+      }
+  free (p.in);
+  free (p.out);
+  free (workers);
+  free (args);
+
+  return ret;
+}
@@ -0,0 +1,58 @@
+/*
+ * Pipelined stream runner with reader, worker and writer stages
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "record.h"
+
+/* Consumer of the output records, returns 0 on success */
+typedef int pipeline_out_fn (void *arg, uint8_t status, const uint8_t *buf,
+                             size_t len);
+
+/* Process the framed input records of fp_in with fn until the end of the
+ * input. A reader thread reads records into pooled buffers of the size
+ * class that fits them, nworkers worker threads run fn and the calling
+ * thread hands the output records to out in input order and returns the
+ * buffers to the pool. The stages are connected by single-producer,
+ * single-consumer lock-free rings, nothing is allocated once records are
+ * flowing.
+ *
+ * Returns 0 on success and -1 on setup failures, truncated input or
+ * failures of out
+ */
+int pipeline_run (record_fn *fn, unsigned nworkers, FILE *fp_in,
+                  pipeline_out_fn *out, void *arg);
+
+#endif /* PIPELINE_H */
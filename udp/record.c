@@ -0,0 +1,364 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "record.h"
+#include "rx.h"
+#include "stats.h"
+#include "tx.h"
+
+/* UDP-Lite checksum coverage used by record_tx, or -1 for plain UDP */
+static long record_tx_coverage = -1;
+
+/* Count a datagram of the rx path in the flow statistics */
+static void
+record_rx_stats (uint8_t proto, uint32_t addr_src, uint32_t addr_dst,
+                 uint16_t port_src, uint16_t port_dst, size_t dgram_len,
+                 int error, bool zero_checksum)
+{
+  struct stats_key key;
+
+  key.addr_src = addr_src;
+  key.addr_dst = addr_dst;
+  key.port_src = port_src;
+  key.port_dst = port_dst;
+  key.proto = proto;
+  stats_update (&key, dgram_len, error, zero_checksum);
+}
+
+uint8_t
+record_rx_dgram (bool verbose, uint8_t proto, uint32_t addr_src,
+                 uint32_t addr_dst, const uint8_t *dgram, size_t dgram_len,
+                 uint8_t *out, size_t *out_len)
+{
+  struct udp_rx_state st;
+  uint32_t result_addr_src;
+  uint16_t port_dst, port_src, payload_len;
+  int ret;
+
+  *out_len = 0;
+  /* The datapath needs at least a complete UDP header */
+  if (UDP_HDR_LEN > dgram_len || IP_MAX_DGRAM_LEN < dgram_len)
+    return RECORD_STATUS_MALFORMED;
+  if (UDP_PROTO != proto && UDPLITE_PROTO != proto)
+    {
+      if (stats_enabled ())
+        record_rx_stats (proto, addr_src, addr_dst, 0, 0, dgram_len,
+                         RX_ERROR_NOT_UDP, false);
+      return RX_ERROR_NOT_UDP;
+    }
+
+  udp_rx_init (&st, udp_rx_get_width ());
+  ret = udp_rx_r (&st, verbose, addr_src, addr_dst, proto, dgram, dgram_len,
+                  &out[RECORD_RX_OUT_HDR_LEN], &payload_len, &port_dst,
+                  &port_src, &result_addr_src);
+  if (stats_enabled ())
+    record_rx_stats (proto, addr_src, addr_dst, st.hdr_udp_port_src,
+                     st.hdr_udp_port_dst, dgram_len, st.error,
+                     0 == st.hdr_udp_checksum);
+  if (0 != ret)
+    return st.error;
+  memcpy (&out[0], &result_addr_src, sizeof (result_addr_src));
+  memcpy (&out[4], &port_src, sizeof (port_src));
+  memcpy (&out[6], &port_dst, sizeof (port_dst));
+  *out_len = RECORD_RX_OUT_HDR_LEN + payload_len;
+
+  return RECORD_STATUS_OK;
+}
+
+uint8_t
+record_rx (bool verbose, const uint8_t *in, size_t in_len, uint8_t *out,
+           size_t *out_len)
+{
+  uint32_t addr_src, addr_dst;
+
+  *out_len = 0;
+  if (RECORD_RX_IN_HDR_LEN > in_len || RECORD_MAX_LEN < in_len)
+    return RECORD_STATUS_MALFORMED;
+  memcpy (&addr_src, &in[1], sizeof (addr_src));
+  memcpy (&addr_dst, &in[5], sizeof (addr_dst));
+
+  return record_rx_dgram (verbose, in[0], addr_src, addr_dst,
+                          &in[RECORD_RX_IN_HDR_LEN],
+                          in_len - RECORD_RX_IN_HDR_LEN, out, out_len);
+}
+
+uint8_t
+record_tx (bool verbose, const uint8_t *in, size_t in_len, uint8_t *out,
+           size_t *out_len)
+{
+  uint32_t addr_src, addr_dst, result_addr_src, result_addr_dst;
+  uint16_t port_src, port_dst, dgram_len;
+  uint8_t result_proto;
+
+  *out_len = 0;
+  if (RECORD_TX_IN_HDR_LEN > in_len
+      || RECORD_TX_IN_HDR_LEN + UINT16_MAX - UDP_HDR_LEN < in_len)
+    return RECORD_STATUS_MALFORMED;
+  memcpy (&addr_src, &in[0], sizeof (addr_src));
+  memcpy (&addr_dst, &in[4], sizeof (addr_dst));
+  memcpy (&port_src, &in[8], sizeof (port_src));
+  memcpy (&port_dst, &in[10], sizeof (port_dst));
+
+  if (0 <= record_tx_coverage)
+    {
+      size_t data_len = in_len - RECORD_TX_IN_HDR_LEN;
+      size_t coverage = record_tx_coverage;
+
+      /* Shorter datagrams are covered entirely */
+      if (UDP_HDR_LEN + data_len <= coverage)
+        coverage = 0;
+      if (0 != udp_tx_lite (verbose, addr_src, addr_dst, port_src, port_dst,
+                            &in[RECORD_TX_IN_HDR_LEN], data_len, coverage,
+                            &out[RECORD_TX_OUT_HDR_LEN], &dgram_len,
+                            &result_addr_src, &result_addr_dst,
+                            &result_proto))
+        return RECORD_STATUS_TX_ERROR;
+    }
+  else if (0 != udp_tx (verbose, addr_src, addr_dst, port_src, port_dst,
+                        &in[RECORD_TX_IN_HDR_LEN],
+                        in_len - RECORD_TX_IN_HDR_LEN,
+                        &out[RECORD_TX_OUT_HDR_LEN], &dgram_len,
+                        &result_addr_src, &result_addr_dst, &result_proto))
+    return RECORD_STATUS_TX_ERROR;
+  memcpy (&out[0], &result_addr_src, sizeof (result_addr_src));
+  memcpy (&out[4], &result_addr_dst, sizeof (result_addr_dst));
+  out[8] = result_proto;
+  *out_len = RECORD_TX_OUT_HDR_LEN + dgram_len;
+
+  return RECORD_STATUS_OK;
+}
+
+int
+record_tx_set_lite (long coverage)
+{
+  if (0 < coverage && UDP_HDR_LEN > coverage)
+    return -1;
+  record_tx_coverage = coverage < 0 ? -1 : coverage;
+
+  return 0;
+}
+
+uint8_t
+record_tx_gso (bool verbose, const uint8_t *in, size_t in_len,
+               size_t seg_len, uint8_t *out, size_t *out_len)
+{
+  const size_t gap = RECORD_FRAME_HDR_LEN + 1 + RECORD_TX_OUT_HDR_LEN;
+  size_t data_len;
+  uint32_t addr_src, addr_dst;
+  uint16_t port_src, port_dst;
+  int n;
+
+  *out_len = 0;
+  if (RECORD_TX_IN_HDR_LEN > in_len)
+    return RECORD_STATUS_MALFORMED;
+  if (0 == seg_len)
+    return RECORD_STATUS_TX_ERROR;
+  memcpy (&addr_src, &in[0], sizeof (addr_src));
+  memcpy (&addr_dst, &in[4], sizeof (addr_dst));
+  memcpy (&port_src, &in[8], sizeof (port_src));
+  memcpy (&port_dst, &in[10], sizeof (port_dst));
+  data_len = in_len - RECORD_TX_IN_HDR_LEN;
+
+  n = udp_tx_gso (verbose, addr_src, addr_dst, port_src, port_dst,
+                  &in[RECORD_TX_IN_HDR_LEN], data_len, seg_len, gap, out,
+                  NULL);
+  if (0 > n)
+    return RECORD_STATUS_TX_ERROR;
+  /* Fill in the frame and record headers left free before each datagram */
+  for (int i = 0; i < n; ++i)
+    {
+      size_t dgram_len = UDP_HDR_LEN + (i + 1 < n ? seg_len
+                                        : data_len - (n - 1) * seg_len);
+      uint32_t frame_len = htonl (1 + RECORD_TX_OUT_HDR_LEN + dgram_len);
+
+      memcpy (&out[0], &frame_len, sizeof (frame_len));
+      out[4] = RECORD_STATUS_OK;
+      memcpy (&out[5], &addr_src, sizeof (addr_src));
+      memcpy (&out[9], &addr_dst, sizeof (addr_dst));
+      out[13] = UDP_PROTO;
+      out += gap + dgram_len;
+      *out_len += gap + dgram_len;
+    }
+
+  return RECORD_STATUS_OK;
+}
+
+/* Discard len bytes of fp */
+static int
+record_skip (FILE *fp, size_t len)
+{
+  for (size_t i = 0; i < len; ++i)
+    if (EOF == fgetc (fp))
+      return -1;
+
+  return 0;
+}
+
+static int
+record_cut_trailer (FILE *fp, uint8_t status, uint32_t addr_src,
+                    uint16_t port_src, uint16_t port_dst)
+{
+  uint8_t trailer[RECORD_CUT_TRAILER_LEN];
+
+  memset (trailer, 0, RECORD_CUT_CHUNK_HDR_LEN);
+  trailer[2] = status;
+  memcpy (&trailer[3], &addr_src, sizeof (addr_src));
+  memcpy (&trailer[7], &port_src, sizeof (port_src));
+  memcpy (&trailer[9], &port_dst, sizeof (port_dst));
+  if (1 != fwrite (trailer, sizeof (trailer), 1, fp))
+    return -1;
+
+  return 0;
+}
+
+int
+record_rx_cut (FILE *fp_in, size_t in_len, FILE *fp_out)
+{
+  struct udp_rx_state st;
+  uint8_t hdr[RECORD_RX_IN_HDR_LEN];
+  uint32_t addr_src, addr_dst;
+  size_t dgram_len;
+
+  if (RECORD_RX_IN_HDR_LEN > in_len || RECORD_MAX_LEN < in_len)
+    {
+      if (0 != record_skip (fp_in, in_len))
+        return -1;
+      return record_cut_trailer (fp_out, RECORD_STATUS_MALFORMED, 0, 0, 0);
+    }
+  if (1 != fread (hdr, sizeof (hdr), 1, fp_in))
+    return -1;
+  memcpy (&addr_src, &hdr[1], sizeof (addr_src));
+  memcpy (&addr_dst, &hdr[5], sizeof (addr_dst));
+  dgram_len = in_len - RECORD_RX_IN_HDR_LEN;
+  if (UDP_HDR_LEN > dgram_len
+      || (UDP_PROTO != hdr[0] && UDPLITE_PROTO != hdr[0]))
+    {
+      uint8_t status = RECORD_STATUS_MALFORMED;
+
+      if (0 != record_skip (fp_in, dgram_len))
+        return -1;
+      if (UDP_HDR_LEN <= dgram_len)
+        {
+          status = RX_ERROR_NOT_UDP;
+          if (stats_enabled ())
+            record_rx_stats (hdr[0], addr_src, addr_dst, 0, 0, dgram_len,
+                             RX_ERROR_NOT_UDP, false);
+        }
+      return record_cut_trailer (fp_out, status, 0, 0, 0);
+    }
+
+  udp_rx_init (&st, udp_rx_get_width ());
+  if (UDPLITE_PROTO == hdr[0])
+    udp_rx_start_lite (&st, addr_src, addr_dst, dgram_len);
+  else
+    udp_rx_start (&st, addr_src, addr_dst, dgram_len);
+  for (size_t i = 0; i < dgram_len; i += st.width)
+    {
+      uint8_t data[UDP_DATA_WIDTH_MAX];
+      uint8_t chunk[RECORD_CUT_CHUNK_HDR_LEN + UDP_DATA_WIDTH_MAX];
+      size_t len, out_len;
+      uint16_t chunk_len;
+
+      len = dgram_len - i < st.width ? dgram_len - i : st.width;
+      if (1 != fread (data, len, 1, fp_in))
+        return -1;
+      udp_rx_pipeline (&st, data, len, &chunk[RECORD_CUT_CHUNK_HDR_LEN],
+                       &out_len);
+      if (0 == out_len)
+        continue;
+      chunk_len = htons (out_len);
+      memcpy (chunk, &chunk_len, sizeof (chunk_len));
+      if (1 != fwrite (chunk, RECORD_CUT_CHUNK_HDR_LEN + out_len, 1, fp_out))
+        return -1;
+    }
+  udp_rx_finish (&st);
+  if (stats_enabled ())
+    record_rx_stats (hdr[0], addr_src, addr_dst, st.hdr_udp_port_src,
+                     st.hdr_udp_port_dst, dgram_len, st.error,
+                     0 == st.hdr_udp_checksum);
+
+  return record_cut_trailer (fp_out, st.error, addr_src,
+                             htons (st.hdr_udp_port_src),
+                             htons (st.hdr_udp_port_dst));
+}
+
+int
+record_read_len (FILE *fp, size_t *len)
+{
+  uint32_t frame_len;
+  size_t n;
+
+  n = fread (&frame_len, 1, sizeof (frame_len), fp);
+  if (0 == n && feof (fp))
+    return 1;
+  if (sizeof (frame_len) != n)
+    return -1;
+  *len = ntohl (frame_len);
+
+  return 0;
+}
+
+int
+record_read (FILE *fp, uint8_t *buf, size_t size, size_t *len)
+{
+  size_t n;
+  int ret;
+
+  ret = record_read_len (fp, len);
+  if (0 != ret)
+    return ret;
+  n = *len < size ? *len : size;
+  if (n != fread (buf, 1, n, fp))
+    return -1;
+  /* Discard the part of the body that does not fit */
+  return record_skip (fp, *len - n);
+}
+
+int
+record_write (FILE *fp, uint8_t status, const uint8_t *buf, size_t len)
+{
+  uint32_t frame_len;
+
+  frame_len = htonl (sizeof (status) + len);
+  if (1 != fwrite (&frame_len, sizeof (frame_len), 1, fp))
+    return -1;
+  if (1 != fwrite (&status, sizeof (status), 1, fp))
+    return -1;
+  if (0 != len && 1 != fwrite (buf, len, 1, fp))
+    return -1;
+
+  return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Record formats and stream framing for the udp program
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+
+/* RX input record (all integer types are network byte order):
+ * Protocol, UDP or UDP-Lite
+ * Source address
+ * Destination address
+ * IP datagram data section (up to 65535 bytes)
+ */
+#define RECORD_RX_IN_HDR_LEN 9U
+/* RX output record (all integer types are network byte order):
+ * Source address
+ * Source port
+ * Destination port
+ * UDP datagram's data payload
+ */
+#define RECORD_RX_OUT_HDR_LEN 8U
+/* TX input record (all integer types are network byte order):
+ * Source address
+ * Destination address
+ * Source port
+ * Destination port
+ * Data for the UDP datagram data section (up to 65535 - 8 bytes)
+ */
+#define RECORD_TX_IN_HDR_LEN 12U
+/* TX output record (all integer types are network byte order):
+ * Source address
+ * Destination address
+ * Protocol
+ * UDP datagram
+ */
+#define RECORD_TX_OUT_HDR_LEN 9U
+
+/* Largest record body of any of the formats above */
+#define RECORD_MAX_LEN (RECORD_RX_IN_HDR_LEN + IP_MAX_DGRAM_LEN)
+/* Bound on the output record length for an input record of len bytes */
+#define RECORD_OUT_MAX(len) \
+  ((len) + RECORD_TX_OUT_HDR_LEN + UDP_HDR_LEN - RECORD_TX_IN_HDR_LEN)
+
+/* Status byte of stream output records. Transfer errors of the rx path are
+ * reported with the RX_ERROR_* bits, the remaining bits are used by the
+ * record layer itself.
+ */
+#define RECORD_STATUS_OK (0x0)
+#define RECORD_STATUS_TX_ERROR (0x40)
+#define RECORD_STATUS_MALFORMED (0x80)
+
+/* Stream framing (all integer types are network byte order):
+ * Record length (4 bytes)
+ * Record body
+ *
+ * Input streams carry the input records above as bodies. Output stream
+ * bodies are a status byte followed by the output record, which is empty
+ * unless the status is RECORD_STATUS_OK.
+ */
+#define RECORD_FRAME_HDR_LEN 4U
+
+/* Processes one input record into an output record, see record_rx */
+typedef uint8_t record_fn (bool verbose, const uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t *out_len);
+
+/* Run udp_rx over an RX input record
+ *
+ * verbose: Enable debug printing to stderr if true
+ * in: RX input record
+ * in_len: Length of in
+ * out: Output for the RX output record, RECORD_MAX_LEN bytes
+ * out_len: Length of data written to out
+ *
+ * Returns the record status, out is only valid for RECORD_STATUS_OK
+ */
+uint8_t record_rx (bool verbose, const uint8_t *in, size_t in_len,
+                   uint8_t *out, size_t *out_len);
+/* Same as record_rx for an RX input record given as separate fields, for
+ * datagrams that are not laid out as a record in memory
+ *
+ * proto: Protocol of dgram from the IP header
+ * addr_src: IPv4 source address in network byte order
+ * addr_dst: IPv4 destination address in network byte order
+ * dgram: IP data section
+ * dgram_len: Length of dgram
+ */
+uint8_t record_rx_dgram (bool verbose, uint8_t proto, uint32_t addr_src,
+                         uint32_t addr_dst, const uint8_t *dgram,
+                         size_t dgram_len, uint8_t *out, size_t *out_len);
+/* Run udp_tx over a TX input record, same interface as record_rx. Builds
+ * UDP-Lite datagrams with udp_tx_lite instead after record_tx_set_lite.
+ */
+uint8_t record_tx (bool verbose, const uint8_t *in, size_t in_len,
+                   uint8_t *out, size_t *out_len);
+/* Make record_tx build UDP-Lite datagrams with checksum coverage bytes
+ * covered, 0 for all of them. Datagrams no longer than coverage are covered
+ * entirely. A negative coverage switches back to UDP.
+ *
+ * Returns 0 on success and -1 if coverage is shorter than a UDP header
+ */
+int record_tx_set_lite (long coverage);
+
+/* Bound on the output length of record_tx_gso for an input record of len
+ * bytes
+ */
+#define RECORD_GSO_OUT_MAX(len, seg_len)                                      \
+  (((len) / (seg_len) + 1)                                                   \
+   * (RECORD_FRAME_HDR_LEN + 1 + RECORD_TX_OUT_HDR_LEN + UDP_HDR_LEN) + (len))
+
+/* Run udp_tx_gso over a TX input record, the data of which may be longer
+ * than a datagram can carry
+ *
+ * seg_len: Data bytes per datagram
+ * out: Output for a sequence of framed stream output records, one for each
+ *      datagram, RECORD_GSO_OUT_MAX (in_len, seg_len) bytes
+ * out_len: Length of data written to out
+ *
+ * The remaining arguments are the same as for record_tx. Returns the record
+ * status, out is only valid for RECORD_STATUS_OK.
+ */
+uint8_t record_tx_gso (bool verbose, const uint8_t *in, size_t in_len,
+                       size_t seg_len, uint8_t *out, size_t *out_len);
+
+/* Cut-through RX output (all integer types are network byte order), for each
+ * RX input record:
+ * Any number of payload chunks, one for each bus transfer carrying payload:
+ *   Chunk length (2 bytes, 1 up to the bus width)
+ *   Payload bytes of the transfer
+ * Trailer:
+ *   Zero chunk length (2 bytes)
+ *   Status byte, see RECORD_STATUS_*
+ *   RX output record header, fields not yet received are zero
+ *
+ * Chunks are written before the checksum has been checked, like the payload
+ * on the datapath's output bus, so a consumer must drop the chunks of a
+ * record if the status in its trailer is not RECORD_STATUS_OK.
+ */
+#define RECORD_CUT_CHUNK_HDR_LEN 2U
+#define RECORD_CUT_TRAILER_LEN \
+  (RECORD_CUT_CHUNK_HDR_LEN + 1 + RECORD_RX_OUT_HDR_LEN)
+
+/* Run the rx datapath over an RX input record read from fp_in one bus
+ * transfer at a time and write cut-through output to fp_out as the
+ * transfers are consumed, so memory use does not depend on the datagram
+ * length.
+ *
+ * in_len: Length of the RX input record, from its stream frame header
+ *
+ * Returns 0 on success and -1 on read errors, truncated records or write
+ * errors
+ */
+int record_rx_cut (FILE *fp_in, size_t in_len, FILE *fp_out);
+
+/* Read one framed record from fp
+ *
+ * buf: Output for the record body
+ * size: Size of buf, the remainder of longer bodies is discarded
+ * len: Record body length from the frame header, may be larger than size
+ *
+ * Returns 0 on success, 1 at the end of the stream and -1 on read errors or
+ * truncated records
+ */
+int record_read (FILE *fp, uint8_t *buf, size_t size, size_t *len);
+/* Read only the frame header of the next record from fp, for callers that
+ * read the body themselves. Same return values as record_read.
+ */
+int record_read_len (FILE *fp, size_t *len);
+/* Write one framed output record to fp with the given status byte
+ *
+ * Returns 0 on success
+ */
+int record_write (FILE *fp, uint8_t status, const uint8_t *buf, size_t len);
+
+#endif /* RECORD_H */
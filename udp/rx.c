@@ -35,18 +35,78 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 #include "checksum.h"
 #include "config.h"
 #include "rx.h"
 
-/* Think of these as registers */
-static int error;
-static size_t count;
-static uint16_t hdr_udp_port_src;
-static uint16_t hdr_udp_port_dst;
-static uint16_t hdr_udp_checksum;
-static uint16_t hdr_udp_len;
+/* Bus width for udp_rx and the record layer */
+static size_t udp_rx_width = UDP_DATA_WIDTH_BYTES;
+
+/* Unpack the big endian header fields at offsets from to end of the
+ * datagram, data points at offset from
+ */
+static inline void
+udp_rx_hdr (struct udp_rx_state *st, const uint8_t *data, size_t from,
+            size_t end)
+{
+  /* Fields are at even offsets */
+  for (size_t i = from; i < end; i += 2, data += 2)
+    {
+      uint16_t s;
+
+      memcpy (&s, data, sizeof (s));
+      checksum_ctx_update (&st->checksum, s);
+      switch (i)
+        {
+        case UDP_HDR_OFF_PORT_SRC:
+          st->hdr_udp_port_src = ntohs (s);
+          break;
+        case UDP_HDR_OFF_PORT_DST:
+          st->hdr_udp_port_dst = ntohs (s);
+          break;
+        case UDP_HDR_OFF_LEN:
+          st->hdr_udp_len = ntohs (s);
+          break;
+        case UDP_HDR_OFF_CHK:
+          st->hdr_udp_checksum = ntohs (s);
+          break;
+        default:
+          break;
+        }
+    }
+}
+
+/* Copy and sum one full payload bus word */
+static inline uint64_t
+udp_rx_sum_copy_word (uint8_t *out, const uint8_t *data, const size_t width)
+{
+  uint64_t sum = 0;
+
+  /* Wide buses are worth the vector kernels */
+  if (32 <= width)
+    return checksum_sum_copy (out, data, width);
+  for (size_t i = 0; i < width; i += 2)
+    {
+      uint16_t w;
+
+      memcpy (&w, &data[i], sizeof (w));
+      memcpy (&out[i], &w, sizeof (w));
+      sum += ntohs (w);
+    }
+
+  return sum;
+}
+
+/* Length of the part of a UDP-Lite datagram covered by the checksum, zero
+ * in the header stands for all of it
+ */
+static inline size_t
+udp_rx_coverage (const struct udp_rx_state *st)
+{
+  return 0 == st->hdr_udp_len ? st->dgram_len : st->hdr_udp_len;
+}
 
 /* Defines the data consumption interface. Think of len as a valid signal,
  * since transactions at the end may not always match the bus width. out_len
@@ -54,110 +114,227 @@ static uint16_t hdr_udp_len;
  * It doesn't truly mimic a pipeline, but it goes through the data processing
  * steps that will be encountered in HDL in a sequential fashion with limited
  * data, rather than just extracting data from a complete datagram.
+ *
+ * The body is instantiated for every supported bus width with width as a
+ * constant, so header unpacking and full-word copies get unrolled.
  */
-static void
-udp_rx_pipeline (size_t dgram_len, const uint8_t *data, size_t len,
-                 uint8_t *out, size_t *out_len)
+static inline __attribute__ ((always_inline)) void
+udp_rx_pipeline_body (struct udp_rx_state *st, const uint8_t *data,
+                      size_t len, uint8_t *out, size_t *out_len,
+                      const size_t width)
 {
-  /* Require minimum 4 byte bus, should always get minimum of 32bits at a time
-   * during header data transfer. UDP header fields never cross 32bit
-   * boundaries either, so don't allow non-dword aligned len.
+  /* Require minimum 4 byte bus and transfers aligned to the bus width, only
+   * the last one can be partial. UDP header fields never cross 32bit
+   * boundaries, so they never cross transfers either.
    */
-  if (count < UDP_HDR_LEN)
-    {
-      if (4 > len)
-        assert (count + len >= UDP_HDR_LEN);
-      /* Check alignment if this transfer will only be header data */
-      if (count + len <= UDP_HDR_LEN)
-        assert (0 == len % 4);
-    }
+  assert (0 == st->count % width);
+  assert (len == width || (len < width && st->count + len == st->dgram_len));
 
   *out_len = 0;
+  ++st->beats;
   /* Discard data if an error has occured */
-  if (error)
+  if (st->error)
     return;
-  for (size_t i = count; i < count + len; ++i, ++data)
+  if (st->count < UDP_HDR_LEN)
     {
-      if (i < UDP_HDR_LEN)
-        {
-          /* unpack big endian */
-          uint16_t s = *(uint16_t *)data;
-          switch (i)
-            {
-            case UDP_HDR_OFF_PORT_SRC:
-              hdr_udp_port_src = ntohs (s);
-              checksum_update (s);
-              break;
-            case UDP_HDR_OFF_PORT_DST:
-              hdr_udp_port_dst = ntohs (s);
-              checksum_update (s);
-              break;
-            case UDP_HDR_OFF_LEN:
-              hdr_udp_len = ntohs (s);
-              checksum_update (s);
-              break;
-            case UDP_HDR_OFF_CHK:
-              hdr_udp_checksum = ntohs (s);
-              checksum_update (s);
-              break;
-            default:
-              break;
-            }
-        }
+      /* The header is complete in the first transfer on 8 byte and wider
+       * buses
+       */
+      if (UDP_HDR_LEN <= width && UDP_HDR_LEN <= len)
+        udp_rx_hdr (st, data, 0, UDP_HDR_LEN);
       else
+        udp_rx_hdr (st, data, st->count, st->count + len < UDP_HDR_LEN
+                                         ? st->count + len : UDP_HDR_LEN);
+    }
+  if (st->count + len > UDP_HDR_LEN)
+    {
+      size_t first;
+
+      /* Payload bytes of this transfer start at first. The payload is
+       * checksummed as a byte stream, so words split over two transfers
+       * and the zero padding of the last octet in an odd-length payload are
+       * taken care of by the checksum context.
+       */
+      first = st->count < UDP_HDR_LEN ? UDP_HDR_LEN : st->count;
+      *out_len = st->count + len - first;
+      /* UDP-Lite only sums up to the coverage, the header has been
+       * received by now
+       */
+      if (st->lite && udp_rx_coverage (st) < st->count + len)
         {
-          if (0 == i % 2)
-            {
-              /* last octet in an odd-length payload */
-              if (i + 1 >= dgram_len)
-                /* pad with zero; use htons for portability */
-                checksum_update (htons (*data << 8));
-              else
-                checksum_update (*(uint16_t *)data);
-            }
-          *out = *data;
-          ++out;
-          ++*out_len;
+          size_t cov = udp_rx_coverage (st) < first ? first
+                                                    : udp_rx_coverage (st);
+
+          checksum_ctx_update_copy (&st->checksum, out,
+                                    &data[first - st->count], cov - first);
+          memcpy (&out[cov - first], &data[cov - st->count],
+                  st->count + len - cov);
         }
+      /* Full payload words start on even offsets */
+      else if (width == *out_len)
+        checksum_ctx_add (&st->checksum,
+                          udp_rx_sum_copy_word (out, data, width));
+      else
+        checksum_ctx_update_copy (&st->checksum, out,
+                                  &data[first - st->count], *out_len);
     }
-  count += len;
+  st->count += len;
+}
+
+#define UDP_RX_PIPELINE(w)                                                    \
+  static void                                                                 \
+  udp_rx_pipeline_##w (struct udp_rx_state *st, const uint8_t *data,          \
+                       size_t len, uint8_t *out, size_t *out_len)             \
+  {                                                                           \
+    udp_rx_pipeline_body (st, data, len, out, out_len, w);                    \
+  }
+
+UDP_RX_PIPELINE (4)
+UDP_RX_PIPELINE (8)
+UDP_RX_PIPELINE (16)
+UDP_RX_PIPELINE (32)
+UDP_RX_PIPELINE (64)
+
+void
+udp_rx_pipeline (struct udp_rx_state *st, const uint8_t *data, size_t len,
+                 uint8_t *out, size_t *out_len)
+{
+  st->pipeline (st, data, len, out, out_len);
 }
 
 int
-udp_rx (bool verbose, uint32_t addr_src, uint32_t addr_dst, uint8_t proto,
-        const uint8_t *dgram, size_t dgram_len, uint8_t *out,
-        uint16_t *out_len, uint16_t *out_port_dst, uint16_t *out_port_src,
-        uint32_t *out_addr_src)
+udp_rx_init (struct udp_rx_state *st, size_t width)
 {
+  switch (width)
+    {
+    case 4:
+      st->pipeline = udp_rx_pipeline_4;
+      break;
+    case 8:
+      st->pipeline = udp_rx_pipeline_8;
+      break;
+    case 16:
+      st->pipeline = udp_rx_pipeline_16;
+      break;
+    case 32:
+      st->pipeline = udp_rx_pipeline_32;
+      break;
+    case 64:
+      st->pipeline = udp_rx_pipeline_64;
+      break;
+    default:
+      return -1;
+    }
+  st->width = width;
+
+  return 0;
+}
+
+int
+udp_rx_set_width (size_t width)
+{
+  struct udp_rx_state st;
+
+  if (0 != udp_rx_init (&st, width))
+    return -1;
+  udp_rx_width = width;
+
+  return 0;
+}
+
+size_t
+udp_rx_get_width (void)
+{
+  return udp_rx_width;
+}
+
+/* Reset st and checksum the virtual header with protocol proto */
+static void
+udp_rx_start_proto (struct udp_rx_state *st, uint8_t proto,
+                    uint32_t addr_src, uint32_t addr_dst, size_t dgram_len)
+{
+  /* The pipeline reads the complete UDP header */
+  assert (UDP_HDR_LEN <= dgram_len);
   assert (dgram_len <= UINT16_MAX);
-  assert (proto == UDP_PROTO);
 
-  error = RX_ERROR_NONE;
-  count = 0;
-  checksum_reset ();
+  st->error = RX_ERROR_NONE;
+  st->count = 0;
+  st->dgram_len = dgram_len;
+  st->beats = 0;
+  st->hdr_udp_port_src = 0;
+  st->hdr_udp_port_dst = 0;
+  st->hdr_udp_checksum = 0;
+  st->hdr_udp_len = 0;
+  checksum_ctx_reset (&st->checksum);
 
   /* Virtual header checksumming */
-  checksum_update (htons (dgram_len));
-  checksum_update (htons (UDP_PROTO));
-  checksum_update32 (addr_src);
-  checksum_update32 (addr_dst);
+  checksum_ctx_update (&st->checksum, htons (dgram_len));
+  checksum_ctx_update (&st->checksum, htons (proto));
+  checksum_ctx_update32 (&st->checksum, addr_src);
+  checksum_ctx_update32 (&st->checksum, addr_dst);
+  st->lite = UDPLITE_PROTO == proto;
+}
+
+void
+udp_rx_start (struct udp_rx_state *st, uint32_t addr_src, uint32_t addr_dst,
+              size_t dgram_len)
+{
+  udp_rx_start_proto (st, UDP_PROTO, addr_src, addr_dst, dgram_len);
+}
+
+void
+udp_rx_start_lite (struct udp_rx_state *st, uint32_t addr_src,
+                   uint32_t addr_dst, size_t dgram_len)
+{
+  udp_rx_start_proto (st, UDPLITE_PROTO, addr_src, addr_dst, dgram_len);
+}
+
+int
+udp_rx_finish (struct udp_rx_state *st)
+{
+  if (st->lite)
+    {
+      /* The checksum is mandatory for UDP-Lite and the coverage has to
+       * include the header (RFC 3828, 3.1)
+       */
+      if ((0 != st->hdr_udp_len && UDP_HDR_LEN > st->hdr_udp_len)
+          || st->dgram_len < st->hdr_udp_len)
+        st->error |= RX_ERROR_COVERAGE;
+      if (0 == st->hdr_udp_checksum
+          || 0xffff != checksum_ctx_get (&st->checksum))
+        st->error |= RX_ERROR_CHECKSUM;
+    }
+  /* Skip check if header checksum is 0 */
+  else if (0 != st->hdr_udp_checksum)
+    /* 0xffff sum indicates validity */
+    if (0xffff != checksum_ctx_get (&st->checksum))
+      st->error |= RX_ERROR_CHECKSUM;
+
+  return st->error;
+}
+
+int
+udp_rx_r (struct udp_rx_state *st, bool verbose, uint32_t addr_src,
+          uint32_t addr_dst, uint8_t proto, const uint8_t *dgram,
+          size_t dgram_len, uint8_t *out, uint16_t *out_len,
+          uint16_t *out_port_dst, uint16_t *out_port_src,
+          uint32_t *out_addr_src)
+{
+  assert (proto == UDP_PROTO || proto == UDPLITE_PROTO);
+
+  udp_rx_start_proto (st, proto, addr_src, addr_dst, dgram_len);
   *out_len = 0;
-  for (size_t i = 0; i < dgram_len; i += UDP_DATA_WIDTH_BYTES)
+  for (size_t i = 0; i < dgram_len; i += st->width)
     {
       size_t l;
-      if (dgram_len - i < UDP_DATA_WIDTH_BYTES)
-        udp_rx_pipeline (dgram_len, &dgram[i], dgram_len - i, out, &l);
+      if (dgram_len - i < st->width)
+        st->pipeline (st, &dgram[i], dgram_len - i, out, &l);
       else
-        udp_rx_pipeline (dgram_len, &dgram[i], UDP_DATA_WIDTH_BYTES, out, &l);
+        st->pipeline (st, &dgram[i], st->width, out, &l);
       *out_len += l;
       out += l;
     }
-
-  /* Skip check if header checksum is 0 */
-  if (0 != hdr_udp_checksum)
-    /* 0xffff sum indicates validity */
-    if (0xffff != checksum_get ())
-      error |= RX_ERROR_CHECKSUM;
+  udp_rx_finish (st);
 
   if (verbose)
     {
@@ -167,21 +344,132 @@ udp_rx (bool verbose, uint32_t addr_src, uint32_t addr_dst, uint8_t proto,
       fprintf (stderr, "Source Address: %s\n", inet_ntoa (a));
       a.s_addr = addr_dst;
       fprintf (stderr, "Destination Address: %s\n", inet_ntoa (a));
-      fprintf (stderr, "Source Port: %" PRIu16 "\n", hdr_udp_port_src);
-      fprintf (stderr, "Destination Port: %" PRIu16 "\n", hdr_udp_port_dst);
+      fprintf (stderr, "Source Port: %" PRIu16 "\n", st->hdr_udp_port_src);
+      fprintf (stderr, "Destination Port: %" PRIu16 "\n",
+               st->hdr_udp_port_dst);
       fprintf (stderr, "UDP Header Checksum: %#" PRIx16 "\n",
-               hdr_udp_checksum);
-      fprintf (stderr, "Data Length from Header: %#" PRIx16 "\n",
-               hdr_udp_len - UDP_HDR_LEN);
+               st->hdr_udp_checksum);
+      if (st->lite)
+        fprintf (stderr, "Checksum Coverage from Header: %#" PRIx16 "\n",
+                 st->hdr_udp_len);
+      else
+        fprintf (stderr, "Data Length from Header: %#" PRIx16 "\n",
+                 st->hdr_udp_len - UDP_HDR_LEN);
       fprintf (stderr, "Data Length from Datapath: %#" PRIx16 "\n", *out_len);
-      fprintf (stderr, "Error: %d\n", error);
+      fprintf (stderr, "Bus Transfers: %zu (%zu bytes wide)\n", st->beats,
+               st->width);
+      fprintf (stderr, "Error: %d\n", st->error);
     }
 
-  *out_port_src = htons (hdr_udp_port_src);
-  *out_port_dst = htons (hdr_udp_port_dst);
+  *out_port_src = htons (st->hdr_udp_port_src);
+  *out_port_dst = htons (st->hdr_udp_port_dst);
   *out_addr_src = addr_src;
-  if (RX_ERROR_NONE == error)
+  if (RX_ERROR_NONE == st->error)
     return 0;
   else
     return -1;
 }
+
+int
+udp_rx (bool verbose, uint32_t addr_src, uint32_t addr_dst, uint8_t proto,
+        const uint8_t *dgram, size_t dgram_len, uint8_t *out,
+        uint16_t *out_len, uint16_t *out_port_dst, uint16_t *out_port_src,
+        uint32_t *out_addr_src)
+{
+  struct udp_rx_state st;
+
+  udp_rx_init (&st, udp_rx_width);
+  return udp_rx_r (&st, verbose, addr_src, addr_dst, proto, dgram, dgram_len,
+                   out, out_len, out_port_dst, out_port_src, out_addr_src);
+}
+
+/* Batch loop with the pipeline body inlined for a constant width, see
+ * udp_rx_pipeline_body
+ */
+static inline __attribute__ ((always_inline)) long
+udp_rx_batch_body (const struct udp_rx_batch *b, const size_t width)
+{
+  struct udp_rx_state st;
+  long ok = 0;
+
+  st.width = width;
+  st.pipeline = NULL;
+  for (size_t i = 0; i < b->n; ++i)
+    {
+      const uint8_t *dgram = &b->buf[b->off[i]];
+      uint8_t *out = &b->out[b->out_off[i]];
+      size_t dgram_len = b->len[i], j, out_len, l;
+
+      b->out_len[i] = 0;
+      b->out_port_src[i] = 0;
+      b->out_port_dst[i] = 0;
+      /* Same order of checks as record_rx_dgram */
+      if (UDP_HDR_LEN > dgram_len)
+        {
+          b->error[i] = RX_ERROR_MALFORMED;
+          continue;
+        }
+      if (UDP_PROTO != b->proto[i] && UDPLITE_PROTO != b->proto[i])
+        {
+          b->error[i] = RX_ERROR_NOT_UDP;
+          continue;
+        }
+      udp_rx_start_proto (&st, b->proto[i], b->addr_src[i], b->addr_dst[i],
+                          dgram_len);
+      out_len = 0;
+      /* Full transfers, then the partial one at the end if any */
+      for (j = 0; j + width <= dgram_len; j += width)
+        {
+          udp_rx_pipeline_body (&st, &dgram[j], width, &out[out_len], &l,
+                                width);
+          out_len += l;
+        }
+      if (j < dgram_len)
+        {
+          udp_rx_pipeline_body (&st, &dgram[j], dgram_len - j,
+                                &out[out_len], &l, width);
+          out_len += l;
+        }
+      b->error[i] = udp_rx_finish (&st);
+      b->out_len[i] = out_len;
+      b->out_port_src[i] = htons (st.hdr_udp_port_src);
+      b->out_port_dst[i] = htons (st.hdr_udp_port_dst);
+      if (RX_ERROR_NONE == b->error[i])
+        ++ok;
+    }
+
+  return ok;
+}
+
+#define UDP_RX_BATCH(w)                                                       \
+  static long                                                                 \
+  udp_rx_batch_##w (const struct udp_rx_batch *b)                             \
+  {                                                                           \
+    return udp_rx_batch_body (b, w);                                          \
+  }
+
+UDP_RX_BATCH (4)
+UDP_RX_BATCH (8)
+UDP_RX_BATCH (16)
+UDP_RX_BATCH (32)
+UDP_RX_BATCH (64)
+
+long
+udp_rx_batch (const struct udp_rx_batch *b, size_t width)
+{
+  switch (width)
+    {
+    case 4:
+      return udp_rx_batch_4 (b);
+    case 8:
+      return udp_rx_batch_8 (b);
+    case 16:
+      return udp_rx_batch_16 (b);
+    case 32:
+      return udp_rx_batch_32 (b);
+    case 64:
+      return udp_rx_batch_64 (b);
+    default:
+      return -1;
+    }
+}
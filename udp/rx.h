@@ -35,21 +35,29 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "checksum.h"
 
 #define RX_ERROR_NONE (0x0)
 #define RX_ERROR_CHECKSUM (0x1)
 #define RX_ERROR_PORT (0x2) /* no longer used */
 #define RX_ERROR_IP_HDR_LEN (0x4) /* no longer used */
 #define RX_ERROR_NOT_UDP (0x8)
+/* UDP-Lite checksum coverage shorter than the header or beyond the end */
+#define RX_ERROR_COVERAGE (0x10)
+/* Shorter than the UDP header, only reported by udp_rx_batch. Same value as
+ * RECORD_STATUS_MALFORMED.
+ */
+#define RX_ERROR_MALFORMED (0x80)
 
 /* UDP receiver executable spec
  *
  * verbose: Enable debug printing to stderr if true
  * addr_src: IPv4 source address in network byte order
  * addr_dst: IPv4 destination address in network byte order
- * proto: Protocol of dgram from the IP header
+ * proto: Protocol of dgram from the IP header, UDP or UDP-Lite. For UDP-Lite
+ *        only the bytes covered by the checksum are summed.
  * dgram: IP data section
- * dgram_len: Length of dgram
+ * dgram_len: Length of dgram, at least UDP_HDR_LEN
  * out: Output array for the datasection of dgram if it is UDP
  * out_len: Length of data written to out
  * out_port_dst: Output for the destination port read from the UDP header
@@ -65,4 +73,121 @@ int udp_rx (bool verbose, uint32_t addr_src, uint32_t addr_dst, uint8_t proto,
             uint16_t *out_len, uint16_t *out_port_dst, uint16_t *out_port_src,
             uint32_t *out_addr_src);
 
+/* Per-datagram state of the receiver, think of these as registers. Each
+ * datagram being processed at the same time needs its own instance.
+ */
+struct udp_rx_state {
+    /* Bus configuration, see udp_rx_init */
+    size_t width;
+    void (*pipeline) (struct udp_rx_state *st, const uint8_t *data,
+                      size_t len, uint8_t *out, size_t *out_len);
+    int error;
+    size_t count;
+    size_t dgram_len;
+    /* Bus transfers consumed for the datagram */
+    size_t beats;
+    uint16_t hdr_udp_port_src;
+    uint16_t hdr_udp_port_dst;
+    uint16_t hdr_udp_checksum;
+    /* Checksum coverage for UDP-Lite */
+    uint16_t hdr_udp_len;
+    struct checksum_ctx checksum;
+    /* UDP-Lite datagram, see udp_rx_start_lite */
+    bool lite;
+};
+
+/* Set up st for a bus of width bytes, a power of two from
+ * UDP_DATA_WIDTH_MIN to UDP_DATA_WIDTH_MAX. Each width has its own
+ * specialized pipeline. Needed once before st is used for any datagram.
+ *
+ * Returns 0 on success and -1 for unsupported widths
+ */
+int udp_rx_init (struct udp_rx_state *st, size_t width);
+
+/* Bus width used by udp_rx and the record layer, UDP_DATA_WIDTH_BYTES
+ * unless changed. Returns 0 on success and -1 for unsupported widths.
+ */
+int udp_rx_set_width (size_t width);
+size_t udp_rx_get_width (void);
+
+/* Reentrant udp_rx, the state of the datagram is kept in st and remains
+ * available to the caller afterwards, e.g. for st->error. st must have been
+ * set up with udp_rx_init and its width is used for the transfers.
+ */
+int udp_rx_r (struct udp_rx_state *st, bool verbose, uint32_t addr_src,
+              uint32_t addr_dst, uint8_t proto, const uint8_t *dgram,
+              size_t dgram_len, uint8_t *out, uint16_t *out_len,
+              uint16_t *out_port_dst, uint16_t *out_port_src,
+              uint32_t *out_addr_src);
+
+/* Descriptors of a batch of datagrams as parallel arrays of n entries each,
+ * for embedding applications that receive many datagrams at once. All
+ * integer fields are in network byte order.
+ */
+struct udp_rx_batch {
+    size_t n;
+    /* Inputs, the datagrams are at offsets of one shared buffer */
+    const uint32_t *addr_src;
+    const uint32_t *addr_dst;
+    const uint8_t *proto;
+    const uint8_t *buf;
+    const size_t *off;
+    const uint16_t *len;
+    /* Outputs, out_off gives a slot of at least len bytes in out for the
+     * data section of each datagram
+     */
+    uint8_t *out;
+    const size_t *out_off;
+    uint16_t *out_len;
+    uint16_t *out_port_src;
+    uint16_t *out_port_dst;
+    /* RX_ERROR_* bits of each datagram */
+    int *error;
+};
+
+/* udp_rx for every datagram of b on a bus of width bytes. The pipeline is
+ * set up once per batch rather than once per datagram. Datagrams shorter
+ * than the UDP header get RX_ERROR_MALFORMED, those that are neither UDP
+ * nor UDP-Lite RX_ERROR_NOT_UDP, and neither gets any output.
+ *
+ * Returns the number of datagrams without errors, or -1 for an unsupported
+ * width
+ */
+long udp_rx_batch (const struct udp_rx_batch *b, size_t width);
+
+/* Lower level interface for driving the datapath one bus transfer at a time.
+ * udp_rx_r is udp_rx_start, udp_rx_pipeline for every transfer and
+ * udp_rx_finish.
+ */
+
+/* Reset st for a new datagram and checksum the virtual header
+ *
+ * addr_src: IPv4 source address in network byte order
+ * addr_dst: IPv4 destination address in network byte order
+ * dgram_len: Length of the IP data section, at least UDP_HDR_LEN
+ */
+void udp_rx_start (struct udp_rx_state *st, uint32_t addr_src,
+                   uint32_t addr_dst, size_t dgram_len);
+/* Same as udp_rx_start for a UDP-Lite datagram. Payload bytes past the
+ * checksum coverage from the header are passed through without being
+ * summed, a zero checksum is an error.
+ */
+void udp_rx_start_lite (struct udp_rx_state *st, uint32_t addr_src,
+                        uint32_t addr_dst, size_t dgram_len);
+/* Consume one bus transfer. Transfers start on bus word boundaries of the
+ * datagram and only the last one may be shorter than the bus width.
+ *
+ * data: Transfer data
+ * len: Number of valid bytes in data
+ * out: Output for the UDP data section bytes of this transfer
+ * out_len: Number of bytes written to out
+ */
+void udp_rx_pipeline (struct udp_rx_state *st, const uint8_t *data,
+                      size_t len, uint8_t *out, size_t *out_len);
+/* Check the checksum once all transfers have been consumed
+ *
+ * Returns the RX_ERROR_* bits of the datagram
+ */
+int udp_rx_finish (struct udp_rx_state *st);
+
 #endif /* RX_H */
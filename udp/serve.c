@@ -0,0 +1,349 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "record.h"
+#include "serve.h"
+
+/* Buffered bytes of a connection in each direction. Input holds at least
+ * one complete request, output is written once per read and when full.
+ */
+#define SERVE_IN_SIZE (2 * (RECORD_FRAME_HDR_LEN + SERVE_REQ_MAX))
+#define SERVE_OUT_SIZE (4 * (RECORD_FRAME_HDR_LEN + 1 + RECORD_MAX_LEN))
+
+struct serve_conn {
+    int fd;
+    uint8_t in[SERVE_IN_SIZE];
+    size_t in_len;
+    uint8_t out[SERVE_OUT_SIZE];
+    size_t out_len;
+};
+
+static int
+serve_write_all (int fd, const uint8_t *buf, size_t len)
+{
+  while (0 < len)
+    {
+      ssize_t n = write (fd, buf, len);
+
+      if (0 > n)
+        {
+          if (EINTR == errno)
+            continue;
+          return -1;
+        }
+      buf += n;
+      len -= n;
+    }
+
+  return 0;
+}
+
+static int
+serve_flush (struct serve_conn *c)
+{
+  int ret = serve_write_all (c->fd, c->out, c->out_len);
+
+  c->out_len = 0;
+  return ret;
+}
+
+/* Process one request into a response appended to the output buffer */
+static int
+serve_request (struct serve_conn *c, const uint8_t *req, size_t len)
+{
+  uint32_t frame_len;
+  uint8_t *resp;
+  size_t out_len;
+
+  if (sizeof (c->out) - c->out_len
+      < RECORD_FRAME_HDR_LEN + 1 + RECORD_OUT_MAX (RECORD_MAX_LEN)
+      && 0 != serve_flush (c))
+    return -1;
+  resp = &c->out[c->out_len];
+  out_len = 0;
+  if (1 > len)
+    resp[4] = RECORD_STATUS_MALFORMED;
+  else if (SERVE_OP_RX == req[0])
+    resp[4] = record_rx (false, &req[1], len - 1, &resp[5], &out_len);
+  else if (SERVE_OP_TX == req[0])
+    resp[4] = record_tx (false, &req[1], len - 1, &resp[5], &out_len);
+  else
+    resp[4] = RECORD_STATUS_MALFORMED;
+  frame_len = htonl (1 + out_len);
+  memcpy (resp, &frame_len, sizeof (frame_len));
+  c->out_len += RECORD_FRAME_HDR_LEN + 1 + out_len;
+
+  return 0;
+}
+
+static void *
+serve_conn_main (void *arg)
+{
+  struct serve_conn *c = arg;
+
+  c->in_len = 0;
+  c->out_len = 0;
+  for (;;)
+    {
+      size_t off = 0;
+      ssize_t n;
+
+      n = read (c->fd, &c->in[c->in_len], sizeof (c->in) - c->in_len);
+      if (0 > n && EINTR == errno)
+        continue;
+      if (0 >= n)
+        break;
+      c->in_len += n;
+      /* Every complete request that has arrived */
+      while (RECORD_FRAME_HDR_LEN <= c->in_len - off)
+        {
+          uint32_t len;
+
+          memcpy (&len, &c->in[off], sizeof (len));
+          len = ntohl (len);
+          if (SERVE_REQ_MAX < len)
+            goto out;
+          if (RECORD_FRAME_HDR_LEN + len > c->in_len - off)
+            break;
+          if (0 != serve_request (c, &c->in[off + RECORD_FRAME_HDR_LEN],
+                                  len))
+            goto out;
+          off += RECORD_FRAME_HDR_LEN + len;
+        }
+      memmove (c->in, &c->in[off], c->in_len - off);
+      c->in_len -= off;
+      /* Responses go out once the pending input has been used up */
+      if (0 != serve_flush (c))
+        break;
+    }
+
+out:
+  close (c->fd);
+  free (c);
+  return NULL;
+}
+
+int
+serve_unix (const char *path)
+{
+  struct sockaddr_un addr;
+  struct stat sb;
+  int fd;
+
+  if (sizeof (addr.sun_path) <= strlen (path))
+    {
+      fprintf (stderr, "Socket path too long: %s\n", path);
+      return -1;
+    }
+  /* Clients going away must not end the server */
+  signal (SIGPIPE, SIG_IGN);
+  if (0 == stat (path, &sb) && S_ISSOCK (sb.st_mode))
+    unlink (path);
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (0 > fd)
+    {
+      perror ("socket");
+      return -1;
+    }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  if (0 != bind (fd, (struct sockaddr *)&addr, sizeof (addr))
+      || 0 != listen (fd, SOMAXCONN))
+    {
+      perror (path);
+      close (fd);
+      return -1;
+    }
+  for (;;)
+    {
+      struct serve_conn *c;
+      pthread_t thread;
+      int conn;
+
+      conn = accept (fd, NULL, NULL);
+      if (0 > conn)
+        {
+          if (EINTR == errno || ECONNABORTED == errno)
+            continue;
+          perror ("accept");
+          break;
+        }
+      c = malloc (sizeof (*c));
+      if (NULL == c)
+        {
+          close (conn);
+          continue;
+        }
+      c->fd = conn;
+      if (0 != pthread_create (&thread, NULL, serve_conn_main, c))
+        {
+          close (conn);
+          free (c);
+          continue;
+        }
+      pthread_detach (thread);
+    }
+  close (fd);
+
+  return -1;
+}
+
+/* Sending side of serve_call */
+struct serve_sender {
+    int fd;
+    const struct serve_batch *batches;
+    size_t n;
+    int status;
+};
+
+static void *
+serve_sender_main (void *arg)
+{
+  struct serve_sender *s = arg;
+  uint8_t *req;
+
+  s->status = -1;
+  req = malloc (RECORD_FRAME_HDR_LEN + SERVE_REQ_MAX);
+  if (NULL == req)
+    goto out;
+  for (size_t i = 0; i < s->n; ++i)
+    {
+      size_t len;
+      uint32_t frame_len;
+      int ret;
+
+      while (0 == (ret = record_read_len (s->batches[i].fp, &len)))
+        {
+          if (RECORD_MAX_LEN < len
+              || len != fread (&req[RECORD_FRAME_HDR_LEN + 1], 1, len,
+                               s->batches[i].fp))
+            goto out;
+          frame_len = htonl (1 + len);
+          memcpy (req, &frame_len, sizeof (frame_len));
+          req[RECORD_FRAME_HDR_LEN] = s->batches[i].op;
+          if (0 != serve_write_all (s->fd, req,
+                                    RECORD_FRAME_HDR_LEN + 1 + len))
+            goto out;
+        }
+      if (1 != ret)
+        goto out;
+    }
+  s->status = 0;
+
+out:
+  free (req);
+  /* The server answers what it has got and closes the connection */
+  shutdown (s->fd, SHUT_WR);
+  return NULL;
+}
+
+int
+serve_call (const char *path, const struct serve_batch *batches, size_t n,
+            FILE *fp_out)
+{
+  static uint8_t buf[SERVE_OUT_SIZE];
+  struct sockaddr_un addr;
+  struct serve_sender sender;
+  pthread_t thread;
+  int status = 0;
+  ssize_t len;
+
+  if (sizeof (addr.sun_path) <= strlen (path))
+    {
+      fprintf (stderr, "Socket path too long: %s\n", path);
+      return -1;
+    }
+  sender.fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (0 > sender.fd)
+    {
+      perror ("socket");
+      return -1;
+    }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  if (0 != connect (sender.fd, (struct sockaddr *)&addr, sizeof (addr)))
+    {
+      perror (path);
+      close (sender.fd);
+      return -1;
+    }
+  sender.batches = batches;
+  sender.n = n;
+  if (0 != pthread_create (&thread, NULL, serve_sender_main, &sender))
+    {
+      close (sender.fd);
+      return -1;
+    }
+  /* Responses are read while requests are still being sent, so neither
+   * side can block the other on full socket buffers
+   */
+  while (0 != (len = read (sender.fd, buf, sizeof (buf))))
+    {
+      if (0 > len)
+        {
+          if (EINTR == errno)
+            continue;
+          perror (path);
+          status = -1;
+          break;
+        }
+      if ((size_t)len != fwrite (buf, 1, len, fp_out))
+        {
+          status = -1;
+          break;
+        }
+    }
+  /* Unblocks the sender if the responses could not be taken */
+  if (0 != status)
+    shutdown (sender.fd, SHUT_RDWR);
+  pthread_join (thread, NULL);
+  close (sender.fd);
+  if (0 != sender.status)
+    {
+      fprintf (stderr, "Error sending requests\n");
+      status = -1;
+    }
+
+  return status;
+}
@@ -0,0 +1,75 @@
+/*
+ * Persistent server for the UDP executable spec
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdio.h>
+#include "record.h"
+
+/* Request (all integer types are network byte order):
+ * Request length (4 bytes), counting the bytes that follow
+ * Operation (SERVE_OP_*)
+ * RX or TX input record, see record.h
+ *
+ * Every request gets a response in the stream output record framing of
+ * record.h, in the order the requests were sent. Clients can send any
+ * number of requests before reading responses. A request longer than
+ * SERVE_REQ_MAX closes the connection.
+ */
+#define SERVE_OP_RX 0U
+#define SERVE_OP_TX 1U
+#define SERVE_REQ_MAX (1U + RECORD_MAX_LEN)
+
+/* Listen on a UNIX domain stream socket at path and serve every connection
+ * on a thread of its own. A stale socket at path is replaced. Only returns
+ * on errors.
+ *
+ * Returns -1
+ */
+int serve_unix (const char *path);
+
+/* Requests of one kind for serve_call */
+struct serve_batch {
+    unsigned op; /* SERVE_OP_* */
+    FILE *fp; /* stream input records, see record.h */
+};
+
+/* Connect to the server at path and send the records of batches in order,
+ * all on one connection and without waiting for any responses. The
+ * responses are copied to fp_out as they arrive.
+ *
+ * Returns 0 on success
+ */
+int serve_call (const char *path, const struct serve_batch *batches,
+                size_t n, FILE *fp_out);
+
+#endif /* SERVE_H */
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "rx.h"
+#include "stats.h"
+
+/* Initial number of slots of a table, a power of two */
+#define STATS_SLOTS_INIT 1024
+
+/* Open addressing table with linear probing, kept at most half full */
+struct stats_table {
+    struct stats_flow *flows;
+    size_t mask;
+    size_t count;
+    /* All tables, for stats_dump_json */
+    struct stats_table *next;
+};
+
+static bool stats_on;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_table *stats_tables;
+/* Table of the calling thread, created by its first update */
+static __thread struct stats_table *stats_own;
+
+void
+stats_enable (void)
+{
+  stats_on = true;
+}
+
+bool
+stats_enabled (void)
+{
+  return stats_on;
+}
+
+static size_t
+stats_hash (const struct stats_key *key)
+{
+  uint64_t h;
+
+  h = ((uint64_t)key->addr_src << 32 | key->addr_dst)
+      * UINT64_C (0x9e3779b97f4a7c15);
+  h ^= ((uint64_t)key->port_src << 24 | (uint64_t)key->port_dst << 8
+        | key->proto) * UINT64_C (0xc2b2ae3d27d4eb4f);
+  h ^= h >> 29;
+
+  return h;
+}
+
+static bool
+stats_key_eq (const struct stats_key *a, const struct stats_key *b)
+{
+  return a->addr_src == b->addr_src && a->addr_dst == b->addr_dst
+         && a->port_src == b->port_src && a->port_dst == b->port_dst
+         && a->proto == b->proto;
+}
+
+/* Slot of key in t, an unused one if key is not in t */
+static struct stats_flow *
+stats_find (struct stats_table *t, const struct stats_key *key)
+{
+  size_t i = stats_hash (key) & t->mask;
+
+  while (t->flows[i].used && !stats_key_eq (&t->flows[i].key, key))
+    i = (i + 1) & t->mask;
+
+  return &t->flows[i];
+}
+
+/* Double the size of t. Returns 0 on success */
+static int
+stats_grow (struct stats_table *t)
+{
+  struct stats_flow *old = t->flows;
+  size_t n = t->mask + 1;
+
+  t->flows = calloc (2 * n, sizeof (*t->flows));
+  if (NULL == t->flows)
+    {
+      t->flows = old;
+      return -1;
+    }
+  t->mask = 2 * n - 1;
+  for (size_t i = 0; i < n; ++i)
+    if (old[i].used)
+      *stats_find (t, &old[i].key) = old[i];
+  free (old);
+
+  return 0;
+}
+
+static struct stats_table *
+stats_table_create (size_t slots)
+{
+  struct stats_table *t;
+
+  t = malloc (sizeof (*t));
+  if (NULL == t)
+    return NULL;
+  t->flows = calloc (slots, sizeof (*t->flows));
+  if (NULL == t->flows)
+    {
+      free (t);
+      return NULL;
+    }
+  t->mask = slots - 1;
+  t->count = 0;
+  t->next = NULL;
+
+  return t;
+}
+
+/* Flow of key in t, added if needed. NULL if out of memory. */
+static struct stats_flow *
+stats_get (struct stats_table *t, const struct stats_key *key)
+{
+  struct stats_flow *f = stats_find (t, key);
+
+  if (f->used)
+    return f;
+  if (2 * (t->count + 1) > t->mask + 1)
+    {
+      if (0 != stats_grow (t))
+        return NULL;
+      f = stats_find (t, key);
+    }
+  memset (f, 0, sizeof (*f));
+  f->key = *key;
+  f->used = true;
+  ++t->count;
+
+  return f;
+}
+
+void
+stats_update (const struct stats_key *key, size_t dgram_len, int error,
+              bool zero_checksum)
+{
+  struct stats_flow *f;
+
+  if (!stats_on)
+    return;
+  if (NULL == stats_own)
+    {
+      stats_own = stats_table_create (STATS_SLOTS_INIT);
+      if (NULL == stats_own)
+        return;
+      pthread_mutex_lock (&stats_lock);
+      stats_own->next = stats_tables;
+      stats_tables = stats_own;
+      pthread_mutex_unlock (&stats_lock);
+    }
+  /* Counts are lost rather than failing the datagram */
+  f = stats_get (stats_own, key);
+  if (NULL == f)
+    return;
+  ++f->dgrams;
+  f->bytes += dgram_len;
+  f->checksum_errors += 0 != (error & RX_ERROR_CHECKSUM);
+  f->not_udp += 0 != (error & RX_ERROR_NOT_UDP);
+  f->zero_checksum += zero_checksum;
+}
+
+static int
+stats_cmp (const void *a, const void *b)
+{
+  const struct stats_key *x = &((const struct stats_flow *)a)->key;
+  const struct stats_key *y = &((const struct stats_flow *)b)->key;
+  uint32_t xs = ntohl (x->addr_src), ys = ntohl (y->addr_src);
+  uint32_t xd = ntohl (x->addr_dst), yd = ntohl (y->addr_dst);
+
+  if (xs != ys)
+    return xs < ys ? -1 : 1;
+  if (xd != yd)
+    return xd < yd ? -1 : 1;
+  if (x->proto != y->proto)
+    return x->proto < y->proto ? -1 : 1;
+  if (x->port_src != y->port_src)
+    return x->port_src < y->port_src ? -1 : 1;
+  if (x->port_dst != y->port_dst)
+    return x->port_dst < y->port_dst ? -1 : 1;
+  return 0;
+}
+
+static void
+stats_print_addr (FILE *fp, const char *name, uint32_t addr)
+{
+  const uint8_t *a = (const uint8_t *)&addr;
+
+  fprintf (fp, "\"%s\": \"%u.%u.%u.%u\"", name, a[0], a[1], a[2], a[3]);
+}
+
+static void
+stats_print_counts (FILE *fp, const struct stats_flow *f)
+{
+  fprintf (fp, "\"datagrams\": %" PRIu64 ", \"bytes\": %" PRIu64 ", "
+           "\"checksum_errors\": %" PRIu64 ", \"not_udp\": %" PRIu64 ", "
+           "\"zero_checksum\": %" PRIu64, f->dgrams, f->bytes,
+           f->checksum_errors, f->not_udp, f->zero_checksum);
+}
+
+int
+stats_dump_json (FILE *fp)
+{
+  struct stats_table *all;
+  struct stats_flow *flows, total;
+  size_t n;
+
+  /* Merge the tables of all threads */
+  all = stats_table_create (STATS_SLOTS_INIT);
+  if (NULL == all)
+    return -1;
+  pthread_mutex_lock (&stats_lock);
+  for (struct stats_table *t = stats_tables; NULL != t; t = t->next)
+    for (size_t i = 0; i <= t->mask; ++i)
+      {
+        const struct stats_flow *src = &t->flows[i];
+        struct stats_flow *dst;
+
+        if (!src->used)
+          continue;
+        dst = stats_get (all, &src->key);
+        if (NULL == dst)
+          {
+            pthread_mutex_unlock (&stats_lock);
+            free (all->flows);
+            free (all);
+            return -1;
+          }
+        dst->dgrams += src->dgrams;
+        dst->bytes += src->bytes;
+        dst->checksum_errors += src->checksum_errors;
+        dst->not_udp += src->not_udp;
+        dst->zero_checksum += src->zero_checksum;
+      }
+  pthread_mutex_unlock (&stats_lock);
+
+  /* Compact and sort for output that does not depend on the hash */
+  flows = all->flows;
+  n = 0;
+  for (size_t i = 0; i <= all->mask; ++i)
+    if (flows[i].used)
+      flows[n++] = flows[i];
+  qsort (flows, n, sizeof (*flows), stats_cmp);
+
+  memset (&total, 0, sizeof (total));
+  fprintf (fp, "{\n  \"flows\": [");
+  for (size_t i = 0; i < n; ++i)
+    {
+      const struct stats_flow *f = &flows[i];
+
+      fprintf (fp, "%s\n    {", 0 == i ? "" : ",");
+      stats_print_addr (fp, "src", f->key.addr_src);
+      fprintf (fp, ", ");
+      stats_print_addr (fp, "dst", f->key.addr_dst);
+      fprintf (fp, ", \"proto\": %u, \"src_port\": %u, \"dst_port\": %u, ",
+               f->key.proto, f->key.port_src, f->key.port_dst);
+      stats_print_counts (fp, f);
+      fprintf (fp, "}");
+      total.dgrams += f->dgrams;
+      total.bytes += f->bytes;
+      total.checksum_errors += f->checksum_errors;
+      total.not_udp += f->not_udp;
+      total.zero_checksum += f->zero_checksum;
+    }
+  fprintf (fp, "%s],\n  \"total\": {\"flows\": %zu, ", 0 == n ? "" : "\n  ",
+           n);
+  stats_print_counts (fp, &total);
+  fprintf (fp, "}\n}\n");
+  free (all->flows);
+  free (all);
+
+  return ferror (fp) ? -1 : 0;
+}
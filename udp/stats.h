@@ -0,0 +1,81 @@
+/*
+ * Per-flow statistics of the RX path
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Flow 5-tuple, addresses in network byte order and ports in host byte
+ * order. Ports are 0 for datagrams that are not UDP.
+ */
+struct stats_key {
+    uint32_t addr_src;
+    uint32_t addr_dst;
+    uint16_t port_src;
+    uint16_t port_dst;
+    uint8_t proto;
+};
+
+struct stats_flow {
+    struct stats_key key;
+    bool used;
+    uint64_t dgrams;
+    uint64_t bytes;
+    /* Datagrams failing with RX_ERROR_CHECKSUM */
+    uint64_t checksum_errors;
+    /* Datagrams dropped with RX_ERROR_NOT_UDP */
+    uint64_t not_udp;
+    /* Datagrams sent without a checksum */
+    uint64_t zero_checksum;
+};
+
+/* Start collecting statistics, stats_update does nothing until then */
+void stats_enable (void);
+/* Whether statistics are being collected */
+bool stats_enabled (void);
+/* Count one datagram of the flow key, dgram_len bytes long (IP data
+ * section), with the RX_ERROR_* bits error. Every thread counts into a
+ * table of its own, so the hot path takes no locks and no atomics.
+ */
+void stats_update (const struct stats_key *key, size_t dgram_len, int error,
+                   bool zero_checksum);
+/* Write the flows of all threads to fp as a JSON object, sorted by flow.
+ * Must not run at the same time as stats_update, e.g. only between batches.
+ *
+ * Returns 0 on success
+ */
+int stats_dump_json (FILE *fp);
+
+#endif /* STATS_H */
@@ -0,0 +1,381 @@
+/*
+ * Throughput and latency benchmark for the UDP executable spec
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "rx.h"
+#include "tx.h"
+
+/* Data section lengths, odd and even around the bus widths and up to the
+ * largest datagram
+ */
+static const size_t test_lens[] = {0, 1, 2, 3, 7, 8, 63, 64, 65, 1471, 1472,
+                                   8999, UINT16_MAX - UDP_HDR_LEN};
+#define TEST_LEN_COUNT (sizeof (test_lens) / sizeof (test_lens[0]))
+
+static const uint32_t addr_src = 0x0100007f;
+static const uint32_t addr_dst = 0x04030201;
+
+/* Data of the test cases, shared between them */
+static uint8_t test_data[IP_MAX_DGRAM_LEN];
+static uint8_t test_ref[IP_MAX_DGRAM_LEN];
+static uint8_t test_out[IP_MAX_DGRAM_LEN];
+
+/* Deterministic pseudo-random numbers, the same cases every run */
+static uint32_t
+test_rand (uint32_t *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+/* udp_tx_iov with fragments of random, mostly odd lengths including empty
+ * ones, the gathered datagram must equal udp_tx of the flattened data.
+ * Returns the number of mismatches.
+ */
+static unsigned
+test_tx_iov (uint32_t *seed)
+{
+  static struct iovec iov[IP_MAX_DGRAM_LEN], out_iov[IP_MAX_DGRAM_LEN + 1];
+  unsigned bad = 0;
+
+  for (size_t l = 0; l < TEST_LEN_COUNT; ++l)
+    {
+      size_t len = test_lens[l], off = 0, n;
+      uint16_t port_src = test_rand (seed), port_dst = test_rand (seed);
+      uint16_t ref_len, out_len;
+      uint32_t out_addr_src, out_addr_dst;
+      uint8_t out_proto, hdr[UDP_HDR_LEN];
+      int iovcnt = 0;
+
+      while (off < len)
+        {
+          n = test_rand (seed) % 8;
+          if (n > len - off || IP_MAX_DGRAM_LEN - 1 == iovcnt)
+            n = len - off;
+          iov[iovcnt].iov_base = &test_data[off];
+          iov[iovcnt++].iov_len = n;
+          off += n;
+        }
+      udp_tx (false, addr_src, addr_dst, port_src, port_dst, test_data,
+              len, test_ref, &ref_len, &out_addr_src, &out_addr_dst,
+              &out_proto);
+      if (0 != udp_tx_iov (false, addr_src, addr_dst, port_src, port_dst,
+                           iov, iovcnt, hdr, out_iov, &out_len,
+                           &out_addr_src, &out_addr_dst, &out_proto)
+          || ref_len != out_len || UDP_PROTO != out_proto)
+        {
+          ++bad;
+          continue;
+        }
+      off = 0;
+      for (int i = 0; i < iovcnt + 1; ++i)
+        {
+          memcpy (&test_out[off], out_iov[i].iov_base, out_iov[i].iov_len);
+          off += out_iov[i].iov_len;
+        }
+      if (off != out_len || 0 != memcmp (test_ref, test_out, off))
+        ++bad;
+    }
+  return bad;
+}
+
+/* udp_tx_rewrite of a datagram from udp_tx to new addresses and ports must
+ * equal udp_tx for the new ones. Besides random data, each length is tried
+ * with a datagram sent without a checksum, which has to stay that way, and
+ * with data for which the new checksum is 0xffff rather than 0.
+ */
+static unsigned
+test_tx_rewrite (uint32_t *seed)
+{
+  static uint8_t data[IP_MAX_DGRAM_LEN];
+  unsigned bad = 0;
+
+  for (size_t l = 0; l < TEST_LEN_COUNT; ++l)
+    for (int kind = 0; kind < 3; ++kind)
+      {
+        size_t len = test_lens[l];
+        uint32_t old_src = test_rand (seed), old_dst = test_rand (seed);
+        uint32_t new_src = test_rand (seed), new_dst = test_rand (seed);
+        uint16_t old_port_src = test_rand (seed);
+        uint16_t old_port_dst = test_rand (seed);
+        uint16_t new_port_src = test_rand (seed);
+        uint16_t new_port_dst = test_rand (seed);
+        uint16_t ref_len, out_len, chk, word;
+        uint32_t out_addr_src, out_addr_dst, sum;
+        uint8_t out_proto;
+
+        memcpy (data, test_data, len);
+        if (1 == kind)
+          {
+            /* Add the checksum to the first data word, then the sum is
+             * all ones and its complement 0, which is sent as 0xffff
+             */
+            if (2 > len)
+              continue;
+            udp_tx (false, new_src, new_dst, new_port_src, new_port_dst,
+                    data, len, test_ref, &ref_len, &out_addr_src,
+                    &out_addr_dst, &out_proto);
+            memcpy (&chk, &test_ref[UDP_HDR_OFF_CHK], sizeof (chk));
+            memcpy (&word, data, sizeof (word));
+            sum = (uint32_t)word + chk;
+            word = (sum & 0xffff) + (sum >> 16);
+            memcpy (data, &word, sizeof (word));
+          }
+        udp_tx (false, new_src, new_dst, new_port_src, new_port_dst, data,
+                len, test_ref, &ref_len, &out_addr_src, &out_addr_dst,
+                &out_proto);
+        udp_tx (false, old_src, old_dst, old_port_src, old_port_dst, data,
+                len, test_out, &out_len, &out_addr_src, &out_addr_dst,
+                &out_proto);
+        memcpy (&chk, &test_ref[UDP_HDR_OFF_CHK], sizeof (chk));
+        if (1 == kind && 0xffff != chk)
+          ++bad;
+        if (2 == kind)
+          {
+            memset (&test_ref[UDP_HDR_OFF_CHK], 0, sizeof (chk));
+            memset (&test_out[UDP_HDR_OFF_CHK], 0, sizeof (chk));
+          }
+        if (0 != udp_tx_rewrite (false, old_src, old_dst, new_src, new_dst,
+                                 new_port_src, new_port_dst, test_out,
+                                 out_len)
+            || 0 != memcmp (test_ref, test_out, ref_len))
+          ++bad;
+      }
+  return bad;
+}
+
+/* Datagrams of the batch check, four kinds for each length and the ones
+ * shorter than the UDP header
+ */
+#define TEST_BATCH_MAX (4 * TEST_LEN_COUNT + UDP_HDR_LEN)
+
+/* udp_tx_batch must give the datagrams of udp_tx. Those datagrams, some of
+ * them corrupted, turned into UDP-Lite or another protocol, then go through
+ * udp_rx_batch at every bus width, which must agree with udp_rx_r.
+ */
+static unsigned
+test_batch (uint32_t *seed)
+{
+  static uint32_t addr_srcs[TEST_BATCH_MAX], addr_dsts[TEST_BATCH_MAX];
+  static uint16_t port_srcs[TEST_BATCH_MAX], port_dsts[TEST_BATCH_MAX];
+  static uint16_t lens[TEST_BATCH_MAX], out_lens[TEST_BATCH_MAX];
+  static uint16_t out_port_srcs[TEST_BATCH_MAX];
+  static uint16_t out_port_dsts[TEST_BATCH_MAX];
+  static size_t offs[TEST_BATCH_MAX], out_offs[TEST_BATCH_MAX];
+  static uint8_t protos[TEST_BATCH_MAX];
+  static int errors[TEST_BATCH_MAX];
+  struct udp_tx_batch tb;
+  struct udp_rx_batch rb;
+  uint8_t *dgrams, *out;
+  size_t n = 0, total = 0;
+  unsigned bad = 0;
+
+  for (size_t l = 0; l < TEST_LEN_COUNT; ++l)
+    for (int kind = 0; kind < 4; ++kind)
+      {
+        addr_srcs[n] = test_rand (seed);
+        addr_dsts[n] = test_rand (seed);
+        port_srcs[n] = test_rand (seed);
+        port_dsts[n] = test_rand (seed);
+        /* Odd offsets too, the data need not be aligned */
+        offs[n] = n % 8;
+        lens[n] = test_lens[l];
+        out_offs[n] = total;
+        total += UDP_HDR_LEN + lens[n];
+        ++n;
+      }
+  dgrams = malloc (total);
+  out = malloc (total);
+  if (NULL == dgrams || NULL == out)
+    {
+      fprintf (stderr, "Out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  tb.n = n;
+  tb.addr_src = addr_srcs;
+  tb.addr_dst = addr_dsts;
+  tb.port_src = port_srcs;
+  tb.port_dst = port_dsts;
+  tb.buf = test_data;
+  tb.off = offs;
+  tb.len = lens;
+  tb.out = dgrams;
+  tb.out_off = out_offs;
+  tb.out_len = out_lens;
+  if (n != udp_tx_batch (&tb))
+    ++bad;
+  for (size_t i = 0; i < n; ++i)
+    {
+      uint16_t ref_len;
+      uint32_t out_addr_src, out_addr_dst;
+      uint8_t out_proto;
+
+      udp_tx (false, addr_srcs[i], addr_dsts[i], port_srcs[i], port_dsts[i],
+              &test_data[offs[i]], lens[i], test_ref, &ref_len,
+              &out_addr_src, &out_addr_dst, &out_proto);
+      if (ref_len != out_lens[i]
+          || 0 != memcmp (test_ref, &dgrams[out_offs[i]], ref_len))
+        ++bad;
+    }
+
+  /* The same datagrams as RX input */
+  for (size_t i = 0; i < n; ++i)
+    {
+      uint8_t *dgram = &dgrams[out_offs[i]];
+      uint16_t len;
+      uint32_t out_addr_src, out_addr_dst;
+
+      offs[i] = out_offs[i];
+      lens[i] = out_lens[i];
+      protos[i] = UDP_PROTO;
+      switch (i % 4)
+        {
+        case 1:
+          dgram[lens[i] - 1] ^= 0x10;
+          break;
+        case 2:
+          udp_tx_lite (false, addr_srcs[i], addr_dsts[i], port_srcs[i],
+                       port_dsts[i], &test_data[i % 8],
+                       lens[i] - UDP_HDR_LEN,
+                       lens[i] > 2 * UDP_HDR_LEN ? 2 * UDP_HDR_LEN : 0,
+                       dgram, &len, &out_addr_src, &out_addr_dst,
+                       &protos[i]);
+          break;
+        case 3:
+          protos[i] = 6;
+          break;
+        }
+    }
+  for (size_t len = 0; len < UDP_HDR_LEN; ++len)
+    {
+      addr_srcs[n] = test_rand (seed);
+      addr_dsts[n] = test_rand (seed);
+      protos[n] = UDP_PROTO;
+      offs[n] = 0;
+      lens[n] = len;
+      out_offs[n] = 0;
+      ++n;
+    }
+  rb.n = n;
+  rb.addr_src = addr_srcs;
+  rb.addr_dst = addr_dsts;
+  rb.proto = protos;
+  rb.buf = dgrams;
+  rb.off = offs;
+  rb.len = lens;
+  rb.out = out;
+  rb.out_off = out_offs;
+  rb.out_len = out_lens;
+  rb.out_port_src = out_port_srcs;
+  rb.out_port_dst = out_port_dsts;
+  rb.error = errors;
+  for (size_t width = UDP_DATA_WIDTH_MIN; width <= UDP_DATA_WIDTH_MAX;
+       width *= 2)
+    {
+      struct udp_rx_state st;
+
+      udp_rx_batch (&rb, width);
+      udp_rx_init (&st, width);
+      for (size_t i = 0; i < n; ++i)
+        {
+          uint16_t ref_len, port_src, port_dst;
+          uint32_t out_addr_src;
+
+          if (UDP_HDR_LEN > lens[i] || 6 == protos[i])
+            {
+              if (0 != out_lens[i]
+                  || (UDP_HDR_LEN > lens[i] ? RX_ERROR_MALFORMED
+                                            : RX_ERROR_NOT_UDP) != errors[i])
+                ++bad;
+              continue;
+            }
+          udp_rx_r (&st, false, addr_srcs[i], addr_dsts[i], protos[i],
+                    &dgrams[offs[i]], lens[i], test_ref, &ref_len,
+                    &port_dst, &port_src, &out_addr_src);
+          if (st.error != errors[i] || ref_len != out_lens[i]
+              || port_src != out_port_srcs[i] || port_dst != out_port_dsts[i]
+              || 0 != memcmp (test_ref, &out[out_offs[i]], ref_len))
+            ++bad;
+          /* Make sure the check sees each kind */
+          if ((0 == i % 4 || 2 == i % 4) != (RX_ERROR_NONE == errors[i]))
+            ++bad;
+        }
+    }
+  free (dgrams);
+  free (out);
+
+  return bad;
+}
+
+typedef unsigned test_fn (uint32_t *seed);
+
+struct test_case {
+    const char *name;
+    test_fn *fn;
+};
+
+static const struct test_case tests[] = {
+    {"tx_iov", test_tx_iov},
+    {"tx_rewrite", test_tx_rewrite},
+    {"batch", test_batch},
+};
+#define TEST_COUNT (sizeof (tests) / sizeof (tests[0]))
+
+/* Checks the other transmit and receive entry points against udp_tx and
+ * udp_rx. Each case gives the number of mismatches it found.
+ */
+int
+main (void)
+{
+  uint32_t seed = 1;
+  int failed = 0;
+
+  for (size_t i = 0; i < sizeof (test_data); ++i)
+    test_data[i] = test_rand (&seed);
+  for (size_t i = 0; i < TEST_COUNT; ++i)
+    {
+      unsigned bad = tests[i].fn (&seed);
+
+      if (0 == bad)
+        printf ("%s pass\n", tests[i].name);
+      else
+        {
+          printf ("%s FAIL, %u mismatches\n", tests[i].name, bad);
+          ++failed;
+        }
+    }
+  return 0 == failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
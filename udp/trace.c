@@ -0,0 +1,452 @@
+/*
+ * Driver for the bus-level Rx-Scenarios and Tx-Scenarios traces
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "record.h"
+#include "rx.h"
+#include "tx.h"
+
+/* Scenario trace format, one bus transfer per line, all fields in hex:
+ * Data, the byte at offset 0 of the bus being the rightmost
+ * Valid mask, bit n set if byte n of Data is valid
+ * Start flag digit followed by end flag digit
+ *
+ * The bus width in bytes follows from the line length. The byte stream of
+ * each start to end sequence has the layout of an RX or TX input record,
+ * see record.h. The matching -res.txt files contain the output records of
+ * all datagrams that passed, as space separated hex bytes.
+ */
+#define TRACE_WIDTH_MAX UDP_DATA_WIDTH_MAX
+#define TRACE_LINE_MAX (2 * TRACE_WIDTH_MAX + TRACE_WIDTH_MAX / 4 + 2)
+
+struct trace_line {
+    uint8_t data[TRACE_WIDTH_MAX];
+    uint64_t valid;
+    bool start;
+    bool end;
+};
+
+/* Growable byte buffer */
+struct buf {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+};
+
+static int8_t hex_val[256];
+
+static void
+hex_init (void)
+{
+  memset (hex_val, -1, sizeof (hex_val));
+  for (int i = 0; i < 10; ++i)
+    hex_val['0' + i] = i;
+  for (int i = 0; i < 6; ++i)
+    {
+      hex_val['A' + i] = 10 + i;
+      hex_val['a' + i] = 10 + i;
+    }
+}
+
+static void
+buf_reserve (struct buf *b, size_t len)
+{
+  if (b->len + len <= b->size)
+    return;
+  while (b->len + len > b->size)
+    b->size = b->size ? 2 * b->size : 4096;
+  b->data = realloc (b->data, b->size);
+  if (NULL == b->data)
+    {
+      fprintf (stderr, "Out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+}
+
+static int
+read_file (const char *name, struct buf *b)
+{
+  FILE *fp;
+  size_t n;
+
+  b->len = 0;
+  fp = fopen (name, "rb");
+  if (NULL == fp)
+    return -1;
+  do
+    {
+      buf_reserve (b, 65536);
+      n = fread (&b->data[b->len], 1, 65536, fp);
+      b->len += n;
+    }
+  while (0 != n);
+  n = ferror (fp);
+  fclose (fp);
+
+  return 0 == n ? 0 : -1;
+}
+
+/* Bus width of a trace line of len characters, 0 if there is none */
+static size_t
+line_width (size_t len)
+{
+  size_t width;
+
+  if (len < 2 || 0 != (len - 2) * 4 % 9)
+    return 0;
+  width = (len - 2) * 4 / 9;
+  if (width < 4 || width > TRACE_WIDTH_MAX || 0 != (width & (width - 1)))
+    return 0;
+  return width;
+}
+
+static int
+parse_line (const char *p, size_t width, struct trace_line *l)
+{
+  size_t mask_digits = width / 4;
+
+  for (size_t i = 0; i < width; ++i)
+    {
+      int h = hex_val[(uint8_t)p[2 * (width - 1 - i)]];
+      int lo = hex_val[(uint8_t)p[2 * (width - 1 - i) + 1]];
+      if (0 > (h | lo))
+        return -1;
+      l->data[i] = h << 4 | lo;
+    }
+  p += 2 * width;
+  l->valid = 0;
+  for (size_t i = 0; i < mask_digits; ++i)
+    {
+      int v = hex_val[(uint8_t)p[i]];
+      if (0 > v)
+        return -1;
+      l->valid = l->valid << 4 | v;
+    }
+  p += mask_digits;
+  if (0 > (hex_val[(uint8_t)p[0]] | hex_val[(uint8_t)p[1]]))
+    return -1;
+  l->start = '0' != p[0];
+  l->end = '0' != p[1];
+
+  return 0;
+}
+
+/* Append the valid bytes of l to b */
+static void
+line_bytes (const struct trace_line *l, size_t width, struct buf *b)
+{
+  buf_reserve (b, width);
+  for (size_t i = 0; i < width; ++i)
+    if (l->valid >> i & 1)
+      b->data[b->len++] = l->data[i];
+}
+
+/* Feed the RX input record of one datagram to the datapath. The record
+ * prefix is taken off the bus and the data section is realigned so that
+ * each transfer into udp_rx_pipeline starts on a bus word boundary of the
+ * datagram, with the valid bytes of the transfer as len.
+ */
+static void
+trace_rx (const uint8_t *rec, size_t rec_len, size_t width, struct buf *out)
+{
+  struct udp_rx_state st;
+  uint32_t addr_src, addr_dst;
+  uint16_t port_src, port_dst;
+  size_t dgram_len, hdr_off;
+
+  if (RECORD_RX_IN_HDR_LEN + UDP_HDR_LEN > rec_len
+      || RECORD_RX_IN_HDR_LEN + IP_MAX_DGRAM_LEN < rec_len
+      || UDP_PROTO != rec[0])
+    /* The datapath would flag these as errors */
+    return;
+  memcpy (&addr_src, &rec[1], sizeof (addr_src));
+  memcpy (&addr_dst, &rec[5], sizeof (addr_dst));
+  dgram_len = rec_len - RECORD_RX_IN_HDR_LEN;
+  rec += RECORD_RX_IN_HDR_LEN;
+
+  hdr_off = out->len;
+  buf_reserve (out, RECORD_RX_OUT_HDR_LEN + dgram_len);
+  out->len += RECORD_RX_OUT_HDR_LEN;
+  /* line_width only accepts supported bus widths */
+  udp_rx_init (&st, width);
+  udp_rx_start (&st, addr_src, addr_dst, dgram_len);
+  for (size_t i = 0; i < dgram_len; i += width)
+    {
+      size_t l;
+
+      udp_rx_pipeline (&st, &rec[i], dgram_len - i < width ? dgram_len - i
+                                                           : width,
+                       &out->data[out->len], &l);
+      out->len += l;
+    }
+  if (RX_ERROR_NONE != udp_rx_finish (&st))
+    {
+      out->len = hdr_off;
+      return;
+    }
+  port_src = htons (st.hdr_udp_port_src);
+  port_dst = htons (st.hdr_udp_port_dst);
+  memcpy (&out->data[hdr_off], &addr_src, sizeof (addr_src));
+  memcpy (&out->data[hdr_off + 4], &port_src, sizeof (port_src));
+  memcpy (&out->data[hdr_off + 6], &port_dst, sizeof (port_dst));
+}
+
+static void
+trace_tx (const uint8_t *rec, size_t rec_len, size_t width, struct buf *out)
+{
+  size_t len;
+
+  (void)width;
+  buf_reserve (out, RECORD_OUT_MAX (rec_len));
+  if (RECORD_STATUS_OK == record_tx (false, rec, rec_len,
+                                     &out->data[out->len], &len))
+    out->len += len;
+}
+
+/* Run every datagram of the trace in text, appending the output records to
+ * out
+ *
+ * Returns 0 on success, -1 for malformed traces
+ */
+static int
+run_trace (bool rx, const char *text, size_t text_len, struct buf *out)
+{
+  static struct buf rec;
+  struct trace_line l;
+  size_t width;
+  bool in_dgram;
+  const char *p, *end;
+
+  in_dgram = false;
+  width = 0;
+  rec.len = 0;
+  for (p = text, end = text + text_len; p < end;)
+    {
+      const char *line = p, *eol = memchr (p, '\n', end - p);
+      size_t n;
+
+      if (NULL == eol)
+        eol = end;
+      p = eol < end ? eol + 1 : end;
+      n = eol - line;
+      if (0 < n && '\r' == line[n - 1])
+        --n;
+      if (0 == n)
+        continue;
+      if (0 == width)
+        width = line_width (n);
+      if (0 == width || line_width (n) != width
+          || 0 != parse_line (line, width, &l))
+        return -1;
+
+      if (l.start)
+        {
+          in_dgram = true;
+          rec.len = 0;
+        }
+      if (!in_dgram)
+        continue;
+      line_bytes (&l, width, &rec);
+      if (l.end)
+        {
+          in_dgram = false;
+          if (rx)
+            trace_rx (rec.data, rec.len, width, out);
+          else
+            trace_tx (rec.data, rec.len, width, out);
+        }
+    }
+
+  return 0;
+}
+
+/* Parse space separated hex bytes, as found in -res.txt files */
+static int
+parse_res (const char *text, size_t len, struct buf *b)
+{
+  b->len = 0;
+  buf_reserve (b, len / 2);
+  for (size_t i = 0; i < len;)
+    {
+      if (' ' == text[i] || '\n' == text[i] || '\r' == text[i]
+          || '\t' == text[i])
+        {
+          ++i;
+          continue;
+        }
+      if (i + 1 >= len || 0 > (hex_val[(uint8_t)text[i]]
+                               | hex_val[(uint8_t)text[i + 1]]))
+        return -1;
+      b->data[b->len++] = hex_val[(uint8_t)text[i]] << 4
+                          | hex_val[(uint8_t)text[i + 1]];
+      i += 2;
+    }
+
+  return 0;
+}
+
+/* Read the -res.txt file belonging to trace name into b */
+static int
+read_res (const char *name, struct buf *text, struct buf *b)
+{
+  size_t n = strlen (name);
+  char *res_name;
+  int ret;
+
+  if (4 > n || 0 != strcmp (&name[n - 4], ".txt"))
+    return -1;
+  res_name = malloc (n + sizeof ("-res"));
+  if (NULL == res_name)
+    return -1;
+  memcpy (res_name, name, n - 4);
+  strcpy (&res_name[n - 4], "-res.txt");
+  ret = read_file (res_name, text);
+  free (res_name);
+  if (0 != ret)
+    return -1;
+
+  return parse_res ((const char *)text->data, text->len, b);
+}
+
+static void
+print_res (const struct buf *b, FILE *fp)
+{
+  static const char digits[] = "0123456789ABCDEF";
+
+  for (size_t i = 0; i < b->len; ++i)
+    {
+      if (0 != i)
+        fputc (' ', fp);
+      fputc (digits[b->data[i] >> 4], fp);
+      fputc (digits[b->data[i] & 0xf], fp);
+    }
+  fputc ('\n', fp);
+}
+
+void
+usage (char *name)
+{
+  fprintf (stderr,
+           "Usage:\n"
+           "\t%s <rx|tx> [--check|-c] <trace.txt>...\n"
+           "\nRuns scenario traces through the datapath and prints the\n"
+           "output records in the -res.txt format. With --check, the output\n"
+           "of each trace is compared to the trace's -res.txt file instead\n",
+           name);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct buf text = { 0 }, out = { 0 }, expected = { 0 };
+  bool rx, check;
+  int i, status;
+  unsigned long passed;
+
+  if (argc < 3)
+    {
+      fprintf (stderr, "Not enough arguments\n");
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+  if (0 == strcmp (argv[1], "rx"))
+    rx = true;
+  else if (0 == strcmp (argv[1], "tx"))
+    rx = false;
+  else
+    {
+      fprintf (stderr, "Invalid argument\n");
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+  i = 2;
+  check = false;
+  if (0 == strcmp (argv[i], "--check") || 0 == strcmp (argv[i], "-c"))
+    {
+      check = true;
+      ++i;
+    }
+
+  hex_init ();
+  status = EXIT_SUCCESS;
+  passed = 0;
+  for (; i < argc; ++i)
+    {
+      if (0 != read_file (argv[i], &text))
+        {
+          fprintf (stderr, "%s: failed to read\n", argv[i]);
+          status = EXIT_FAILURE;
+          continue;
+        }
+      out.len = 0;
+      if (0 != run_trace (rx, (const char *)text.data, text.len, &out))
+        {
+          fprintf (stderr, "%s: malformed trace\n", argv[i]);
+          status = EXIT_FAILURE;
+          continue;
+        }
+      if (!check)
+        {
+          print_res (&out, stdout);
+          continue;
+        }
+
+      if (0 != read_res (argv[i], &text, &expected))
+        {
+          fprintf (stderr, "%s: failed to read the -res.txt file\n",
+                   argv[i]);
+          status = EXIT_FAILURE;
+          continue;
+        }
+      if (expected.len == out.len
+          && 0 == memcmp (expected.data, out.data, out.len))
+        ++passed;
+      else
+        {
+          fprintf (stderr, "%s: FAIL\n", argv[i]);
+          status = EXIT_FAILURE;
+        }
+    }
+  if (check)
+    printf ("%lu of %d traces pass\n", passed, argc - 3);
+
+  free (text.data);
+  free (out.data);
+  free (expected.data);
+
+  return status;
+}
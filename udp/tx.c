@@ -31,9 +31,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 #include <assert.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 #include "checksum.h"
 #include "config.h"
 #include "tx.h"
@@ -52,6 +54,63 @@ struct udp_dgram_hdr {
     uint16_t checksum;
 };
 
+/* Fill in hdr apart from the checksum and start the checksum calculation
+ * with the header and the pseudo header of protocol proto. len is the
+ * length field of the header, the datagram length for UDP and the checksum
+ * coverage for UDP-Lite.
+ */
+static void
+udp_tx_hdr_proto (struct udp_dgram_hdr *hdr, struct checksum_ctx *checksum,
+                  uint8_t proto, uint16_t len, uint32_t addr_src,
+                  uint32_t addr_dst, uint16_t port_src, uint16_t port_dst,
+                  size_t data_len)
+{
+  struct udp_dgram_pseudo_hdr pseudo_hdr;
+
+  hdr->port_src = port_src;
+  hdr->port_dst = port_dst;
+  hdr->len = htons (len);
+  hdr->checksum = 0;
+  pseudo_hdr.addr_src = addr_src;
+  pseudo_hdr.addr_dst = addr_dst;
+  pseudo_hdr.proto = htons (proto);
+  pseudo_hdr.udp_len = htons (sizeof (*hdr) + data_len);
+  checksum_ctx_reset (checksum);
+  checksum_ctx_update (checksum, hdr->port_src);
+  checksum_ctx_update (checksum, hdr->port_dst);
+  checksum_ctx_update (checksum, hdr->len);
+  checksum_ctx_update32 (checksum, pseudo_hdr.addr_src);
+  checksum_ctx_update32 (checksum, pseudo_hdr.addr_dst);
+  checksum_ctx_update (checksum, pseudo_hdr.proto);
+  checksum_ctx_update (checksum, pseudo_hdr.udp_len);
+}
+
+static void
+udp_tx_hdr (struct udp_dgram_hdr *hdr, struct checksum_ctx *checksum,
+            uint32_t addr_src, uint32_t addr_dst, uint16_t port_src,
+            uint16_t port_dst, size_t data_len)
+{
+  udp_tx_hdr_proto (hdr, checksum, UDP_PROTO, sizeof (*hdr) + data_len,
+                    addr_src, addr_dst, port_src, port_dst, data_len);
+}
+
+/* Print hdr, the length field of which is the coverage if lite */
+static void
+udp_tx_print_proto (const struct udp_dgram_hdr *hdr, bool lite)
+{
+  fprintf (stderr, "Source port: %" PRIu16 "\n", ntohs (hdr->port_src));
+  fprintf (stderr, "Destination port: %" PRIu16 "\n", ntohs (hdr->port_dst));
+  fprintf (stderr, "%s: %" PRIu16 "\n", lite ? "Checksum coverage" : "Length",
+           ntohs (hdr->len));
+  fprintf (stderr, "Checksum: %#" PRIx16 "\n", ntohs (hdr->checksum));
+}
+
+static void
+udp_tx_print (const struct udp_dgram_hdr *hdr)
+{
+  udp_tx_print_proto (hdr, false);
+}
+
 /* NOTE: Didn't bother to mimic HDL flow like with udp_rx */
 int
 udp_tx (bool verbose, uint32_t addr_src, uint32_t addr_dst, uint16_t port_src,
@@ -59,55 +118,283 @@ udp_tx (bool verbose, uint32_t addr_src, uint32_t addr_dst, uint16_t port_src,
         uint8_t *out, uint16_t *out_len, uint32_t *out_addr_src,
         uint32_t *out_addr_dst, uint8_t *out_proto)
 {
-  struct udp_dgram_hdr *hdr;
-  struct udp_dgram_pseudo_hdr pseudo_hdr;
+  struct udp_dgram_hdr hdr;
+  struct checksum_ctx checksum;
   uint8_t *payload;
 
-  assert (UINT16_MAX >= sizeof (*hdr) + data_len);
+  assert (UINT16_MAX >= sizeof (hdr) + data_len);
 
-  hdr = (struct udp_dgram_hdr *)out;
-  payload = out + sizeof (*hdr);
+  /* out need not be aligned for the header, e.g. behind a record header */
+  payload = out + sizeof (hdr);
 
-  hdr->port_src = port_src;
-  hdr->port_dst = port_dst;
-  hdr->len = htons (sizeof (*hdr) + data_len);
-  pseudo_hdr.addr_src = addr_src;
-  pseudo_hdr.addr_dst = addr_dst;
-  pseudo_hdr.proto = htons (UDP_PROTO);
-  pseudo_hdr.udp_len = hdr->len;
+  udp_tx_hdr (&hdr, &checksum, addr_src, addr_dst, port_src, port_dst,
+              data_len);
   /* Copy data payload */
-  for (size_t i = 0; i < data_len; ++i)
-    payload[i] = data[i];
-  *out_len = ntohs (hdr->len);
+  memcpy (payload, data, data_len);
+  *out_len = ntohs (hdr.len);
   /* Handle checksum calculation */
-  checksum_reset ();
-  checksum_update (hdr->port_src);
-  checksum_update (hdr->port_dst);
-  checksum_update (hdr->len);
-  checksum_update32 (pseudo_hdr.addr_src);
-  checksum_update32 (pseudo_hdr.addr_dst);
-  checksum_update (pseudo_hdr.proto);
-  checksum_update (pseudo_hdr.udp_len);
-  size_t word_len = data_len / 2;
-  for (uint16_t *d = (uint16_t *)payload; d < (uint16_t *)payload + word_len;
-       ++d)
-    checksum_update (*d);
-  if (0 != data_len % 2)
-    checksum_update (htons (data[data_len - 1] << 8));
-  hdr->checksum = checksum_get_hdr_fmt ();
+  checksum_ctx_update_buf (&checksum, payload, data_len);
+  hdr.checksum = checksum_ctx_get_hdr_fmt (&checksum);
+  memcpy (out, &hdr, sizeof (hdr));
   /* Fill in remaining outputs */
-  *out_addr_src = pseudo_hdr.addr_src;
-  *out_addr_dst = pseudo_hdr.addr_dst;
+  *out_addr_src = addr_src;
+  *out_addr_dst = addr_dst;
   *out_proto = UDP_PROTO;
 
   if (verbose)
+    udp_tx_print (&hdr);
+
+  return 0;
+}
+
+int
+udp_tx_lite (bool verbose, uint32_t addr_src, uint32_t addr_dst,
+             uint16_t port_src, uint16_t port_dst, const uint8_t *data,
+             size_t data_len, size_t coverage, uint8_t *out,
+             uint16_t *out_len, uint32_t *out_addr_src,
+             uint32_t *out_addr_dst, uint8_t *out_proto)
+{
+  struct udp_dgram_hdr hdr;
+  struct checksum_ctx checksum;
+  uint8_t *payload;
+  size_t covered;
+
+  assert (UINT16_MAX >= sizeof (hdr) + data_len);
+  if ((0 != coverage && sizeof (hdr) > coverage)
+      || sizeof (hdr) + data_len < coverage)
+    return -1;
+
+  payload = out + sizeof (hdr);
+
+  udp_tx_hdr_proto (&hdr, &checksum, UDPLITE_PROTO, coverage, addr_src,
+                    addr_dst, port_src, port_dst, data_len);
+  memcpy (payload, data, data_len);
+  *out_len = sizeof (hdr) + data_len;
+  /* Only the covered data, an odd last byte is padded like at the end */
+  covered = 0 == coverage ? data_len : coverage - sizeof (hdr);
+  checksum_ctx_update_buf (&checksum, payload, covered);
+  hdr.checksum = checksum_ctx_get_hdr_fmt (&checksum);
+  memcpy (out, &hdr, sizeof (hdr));
+  *out_addr_src = addr_src;
+  *out_addr_dst = addr_dst;
+  *out_proto = UDPLITE_PROTO;
+
+  if (verbose)
+    udp_tx_print_proto (&hdr, true);
+
+  return 0;
+}
+
+int
+udp_tx_iov (bool verbose, uint32_t addr_src, uint32_t addr_dst,
+            uint16_t port_src, uint16_t port_dst, const struct iovec *iov,
+            int iovcnt, uint8_t *hdr_out, struct iovec *out_iov,
+            uint16_t *out_len, uint32_t *out_addr_src,
+            uint32_t *out_addr_dst, uint8_t *out_proto)
+{
+  struct udp_dgram_hdr hdr;
+  struct checksum_ctx checksum;
+  size_t data_len;
+
+  data_len = 0;
+  for (int i = 0; i < iovcnt; ++i)
+    data_len += iov[i].iov_len;
+  if (UINT16_MAX < sizeof (hdr) + data_len)
+    return -1;
+
+  udp_tx_hdr (&hdr, &checksum, addr_src, addr_dst, port_src, port_dst,
+              data_len);
+  /* Fragments may have odd lengths, so checksum them as a byte stream */
+  for (int i = 0; i < iovcnt; ++i)
+    checksum_ctx_update_bytes (&checksum, iov[i].iov_base, iov[i].iov_len);
+  hdr.checksum = checksum_ctx_get_hdr_fmt (&checksum);
+  memcpy (hdr_out, &hdr, sizeof (hdr));
+
+  out_iov[0].iov_base = hdr_out;
+  out_iov[0].iov_len = sizeof (hdr);
+  for (int i = 0; i < iovcnt; ++i)
+    out_iov[i + 1] = iov[i];
+  *out_len = ntohs (hdr.len);
+  *out_addr_src = addr_src;
+  *out_addr_dst = addr_dst;
+  *out_proto = UDP_PROTO;
+
+  if (verbose)
+    udp_tx_print (&hdr);
+
+  return 0;
+}
+
+int
+udp_tx_gso (bool verbose, uint32_t addr_src, uint32_t addr_dst,
+            uint16_t port_src, uint16_t port_dst, const uint8_t *data,
+            size_t data_len, size_t seg_len, size_t gap, uint8_t *out,
+            uint16_t *out_lens)
+{
+  struct udp_dgram_hdr hdr;
+  struct checksum_ctx base, checksum;
+  size_t off, n;
+
+  if (0 == seg_len || UINT16_MAX - sizeof (hdr) < seg_len)
+    return -1;
+
+  /* Template for full segments */
+  udp_tx_hdr (&hdr, &base, addr_src, addr_dst, port_src, port_dst, seg_len);
+  off = 0;
+  n = 0;
+  do
+    {
+      size_t len = data_len - off < seg_len ? data_len - off : seg_len;
+      uint8_t *dgram = out + gap;
+
+      /* Only the last segment can be shorter */
+      if (seg_len != len)
+        udp_tx_hdr (&hdr, &base, addr_src, addr_dst, port_src, port_dst,
+                    len);
+      checksum = base;
+      checksum_ctx_add (&checksum, checksum_sum_copy (dgram + sizeof (hdr),
+                                                      data + off, len));
+      hdr.checksum = checksum_ctx_get_hdr_fmt (&checksum);
+      memcpy (dgram, &hdr, sizeof (hdr));
+      if (verbose)
+        udp_tx_print (&hdr);
+      if (NULL != out_lens)
+        out_lens[n] = sizeof (hdr) + len;
+      ++n;
+      out = dgram + sizeof (hdr) + len;
+      off += len;
+    }
+  while (off < data_len);
+
+  return n;
+}
+
+int
+udp_tx_rewrite (bool verbose, uint32_t old_addr_src, uint32_t old_addr_dst,
+                uint32_t addr_src, uint32_t addr_dst, uint16_t port_src,
+                uint16_t port_dst, uint8_t *dgram, size_t dgram_len)
+{
+  struct udp_dgram_hdr hdr;
+  uint16_t old_val[6], new_val[6];
+
+  if (sizeof (hdr) > dgram_len)
+    return -1;
+  memcpy (&hdr, dgram, sizeof (hdr));
+  /* Words of the pseudo header and header that change, the old values are
+   * taken out of the sum and the new ones put in
+   */
+  old_val[0] = old_addr_src & 0xffff;
+  old_val[1] = old_addr_src >> 16 & 0xffff;
+  old_val[2] = old_addr_dst & 0xffff;
+  old_val[3] = old_addr_dst >> 16 & 0xffff;
+  old_val[4] = hdr.port_src;
+  old_val[5] = hdr.port_dst;
+  new_val[0] = addr_src & 0xffff;
+  new_val[1] = addr_src >> 16 & 0xffff;
+  new_val[2] = addr_dst & 0xffff;
+  new_val[3] = addr_dst >> 16 & 0xffff;
+  new_val[4] = port_src;
+  new_val[5] = port_dst;
+  hdr.port_src = port_src;
+  hdr.port_dst = port_dst;
+  if (0 != hdr.checksum)
+    hdr.checksum = checksum_hdr_fmt_adjust (hdr.checksum, old_val, new_val,
+                                            6);
+  memcpy (dgram, &hdr, sizeof (hdr));
+
+  if (verbose)
+    udp_tx_print (&hdr);
+
+  return 0;
+}
+
+size_t
+udp_tx_batch (const struct udp_tx_batch *b)
+{
+  size_t ok = 0;
+
+  for (size_t i = 0; i < b->n; ++i)
     {
-      fprintf (stderr, "Source port: %" PRIu16 "\n", ntohs (hdr->port_src));
-      fprintf (stderr, "Destination port: %" PRIu16 "\n",
-               ntohs (hdr->port_dst));
-      fprintf (stderr, "Length: %" PRIu16 "\n", ntohs (hdr->len));
-      fprintf (stderr, "Checksum: %#" PRIx16 "\n", ntohs (hdr->checksum));
+      struct udp_dgram_hdr hdr;
+      struct checksum_ctx checksum;
+      uint8_t *dgram = &b->out[b->out_off[i]];
+      size_t data_len = b->len[i];
+
+      if (UINT16_MAX - sizeof (hdr) < data_len)
+        {
+          b->out_len[i] = 0;
+          continue;
+        }
+      udp_tx_hdr (&hdr, &checksum, b->addr_src[i], b->addr_dst[i],
+                  b->port_src[i], b->port_dst[i], data_len);
+      checksum_ctx_add (&checksum,
+                        checksum_sum_copy (dgram + sizeof (hdr),
+                                           &b->buf[b->off[i]], data_len));
+      hdr.checksum = checksum_ctx_get_hdr_fmt (&checksum);
+      memcpy (dgram, &hdr, sizeof (hdr));
+      b->out_len[i] = sizeof (hdr) + data_len;
+      ++ok;
     }
 
+  return ok;
+}
+
+void
+udp_tx_stream_begin (struct udp_tx_stream *st, uint32_t addr_src,
+                     uint32_t addr_dst, uint16_t port_src, uint16_t port_dst,
+                     uint8_t *hdr_out)
+{
+  struct udp_dgram_hdr hdr;
+
+  st->port_src = port_src;
+  st->port_dst = port_dst;
+  st->data_len = 0;
+  /* Everything but the two length fields, see udp_tx_hdr */
+  checksum_ctx_reset (&st->checksum);
+  checksum_ctx_update (&st->checksum, port_src);
+  checksum_ctx_update (&st->checksum, port_dst);
+  checksum_ctx_update32 (&st->checksum, addr_src);
+  checksum_ctx_update32 (&st->checksum, addr_dst);
+  checksum_ctx_update (&st->checksum, htons (UDP_PROTO));
+  hdr.port_src = port_src;
+  hdr.port_dst = port_dst;
+  hdr.len = 0;
+  hdr.checksum = 0;
+  memcpy (hdr_out, &hdr, sizeof (hdr));
+}
+
+int
+udp_tx_stream_update (struct udp_tx_stream *st, const uint8_t *data,
+                      size_t len)
+{
+  if (UINT16_MAX - UDP_HDR_LEN - st->data_len < len)
+    return -1;
+  checksum_ctx_update_bytes (&st->checksum, data, len);
+  st->data_len += len;
+
   return 0;
 }
+
+void
+udp_tx_stream_finish (struct udp_tx_stream *st, bool verbose,
+                      uint8_t *hdr_out, uint16_t *out_len)
+{
+  struct udp_dgram_hdr hdr;
+  struct checksum_ctx checksum;
+
+  hdr.port_src = st->port_src;
+  hdr.port_dst = st->port_dst;
+  hdr.len = htons (sizeof (hdr) + st->data_len);
+  /* The length is in both the header and the pseudo header. The sum does
+   * not depend on the order of its words, so they can be added after an
+   * odd number of data bytes as well.
+   */
+  checksum = st->checksum;
+  checksum_ctx_add (&checksum, 2 * (sizeof (hdr) + st->data_len));
+  hdr.checksum = checksum_ctx_get_hdr_fmt (&checksum);
+  memcpy (hdr_out, &hdr, sizeof (hdr));
+  *out_len = ntohs (hdr.len);
+
+  if (verbose)
+    udp_tx_print (&hdr);
+}
@@ -35,6 +35,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+#include "checksum.h"
 
 #define TX_ERROR_NONE (0x0)
 
@@ -60,4 +62,161 @@ int udp_tx (bool verbose, uint32_t addr_src, uint32_t addr_dst,
             uint32_t *out_addr_src, uint32_t *out_addr_dst,
             uint8_t *out_proto);
 
+/* UDP-Lite (RFC 3828) transmitter, the checksum only covers the first
+ * coverage bytes of the datagram and the rest is copied through
+ *
+ * coverage: Bytes of the datagram covered by the checksum, including the
+ *           header, or 0 for all of it
+ *
+ * The remaining arguments are the same as for udp_tx.
+ *
+ * Returns 0 on success and -1 if coverage is shorter than the header or
+ * longer than the datagram
+ */
+int udp_tx_lite (bool verbose, uint32_t addr_src, uint32_t addr_dst,
+                 uint16_t port_src, uint16_t port_dst, const uint8_t *data,
+                 size_t data_len, size_t coverage, uint8_t *out,
+                 uint16_t *out_len, uint32_t *out_addr_src,
+                 uint32_t *out_addr_dst, uint8_t *out_proto);
+
+/* Scatter-gather UDP transmitter, the payload is checksummed in place and
+ * never copied
+ *
+ * iov: Fragments of the UDP data section, owned by the caller
+ * iovcnt: Number of entries in iov
+ * hdr_out: Output for the UDP header, UDP_HDR_LEN bytes
+ * out_iov: Output for the complete UDP datagram as a gather list of
+ *          iovcnt + 1 entries, hdr_out followed by the entries of iov. Only
+ *          valid as long as hdr_out and the fragments are, e.g. for writev.
+ * out_len: Length of the UDP datagram
+ *
+ * The remaining arguments are the same as for udp_tx.
+ *
+ * Returns 0 on success and -1 if the datagram would be too long
+ */
+int udp_tx_iov (bool verbose, uint32_t addr_src, uint32_t addr_dst,
+                uint16_t port_src, uint16_t port_dst, const struct iovec *iov,
+                int iovcnt, uint8_t *hdr_out, struct iovec *out_iov,
+                uint16_t *out_len, uint32_t *out_addr_src,
+                uint32_t *out_addr_dst, uint8_t *out_proto);
+
+/* Number of datagrams udp_tx_gso splits data_len bytes into */
+#define UDP_TX_GSO_SEGS(data_len, seg_len) \
+  (0 == (data_len) ? 1 : ((data_len) + (seg_len) - 1) / (seg_len))
+
+/* Segmentation offload transmitter, splits data into datagrams of seg_len
+ * data bytes built from one header template, only the last one can be
+ * shorter. The header and pseudo header part of the checksum is calculated
+ * once per segment length, each payload is copied and summed in one pass.
+ *
+ * data: Data to be sent, any length
+ * seg_len: Data bytes per datagram, from 1 to 65535 - 8
+ * gap: Bytes left untouched in out before each datagram, e.g. for record
+ *      headers
+ * out: Output for the datagrams, each preceded by gap bytes. Needs
+ *      UDP_TX_GSO_SEGS (data_len, seg_len) * (gap + 8) + data_len bytes.
+ * out_lens: Output for the length of each datagram or NULL, all but the
+ *           last one are seg_len + 8 bytes long anyway
+ *
+ * The remaining arguments are the same as for udp_tx.
+ *
+ * Returns the number of datagrams or -1 if seg_len is out of range
+ */
+int udp_tx_gso (bool verbose, uint32_t addr_src, uint32_t addr_dst,
+                uint16_t port_src, uint16_t port_dst, const uint8_t *data,
+                size_t data_len, size_t seg_len, size_t gap, uint8_t *out,
+                uint16_t *out_lens);
+
+/* Re-address a UDP datagram built for other addresses and ports in place.
+ * Only the header is touched, the checksum is patched incrementally (RFC
+ * 1624) rather than recalculated over the payload. A checksum of zero means
+ * none was sent and is left as is.
+ *
+ * verbose: Enable debug printing to stderr if true
+ * old_addr_src: IPv4 source address the datagram was built for
+ * old_addr_dst: IPv4 destination address the datagram was built for
+ * addr_src: New IPv4 source address
+ * addr_dst: New IPv4 destination address
+ * port_src: New UDP source port
+ * port_dst: New UDP destination port
+ * dgram: Complete UDP datagram, rewritten in place
+ * dgram_len: Length of dgram
+ *
+ * Addresses and ports are in network byte order.
+ *
+ * Returns 0 on success and -1 if dgram is shorter than a UDP header
+ */
+int udp_tx_rewrite (bool verbose, uint32_t old_addr_src,
+                    uint32_t old_addr_dst, uint32_t addr_src,
+                    uint32_t addr_dst, uint16_t port_src, uint16_t port_dst,
+                    uint8_t *dgram, size_t dgram_len);
+
+/* Descriptors of a batch of datagrams as parallel arrays of n entries each,
+ * see struct udp_rx_batch. All integer fields are in network byte order.
+ */
+struct udp_tx_batch {
+    size_t n;
+    /* Inputs, the data sections are at offsets of one shared buffer */
+    const uint32_t *addr_src;
+    const uint32_t *addr_dst;
+    const uint16_t *port_src;
+    const uint16_t *port_dst;
+    const uint8_t *buf;
+    const size_t *off;
+    const uint16_t *len;
+    /* Outputs, out_off gives a slot of at least len + 8 bytes in out for
+     * each complete datagram. out_len is 0 for data that does not fit a
+     * datagram.
+     */
+    uint8_t *out;
+    const size_t *out_off;
+    uint16_t *out_len;
+};
+
+/* udp_tx for every datagram of b, each payload is copied and summed in one
+ * pass
+ *
+ * Returns the number of datagrams built
+ */
+size_t udp_tx_batch (const struct udp_tx_batch *b);
+
+/* Streaming transmitter state, for data that arrives in pieces and is never
+ * held in memory as a whole. The length only enters the checksum at the
+ * end, so it does not have to be known in advance.
+ */
+struct udp_tx_stream {
+    uint16_t port_src;
+    uint16_t port_dst;
+    size_t data_len;
+    struct checksum_ctx checksum;
+};
+
+/* Start a datagram on st
+ *
+ * hdr_out: Output for a placeholder UDP header, UDP_HDR_LEN bytes with zero
+ *          length and checksum, to be sent ahead of the data and replaced
+ *          by the header from udp_tx_stream_finish where possible
+ *
+ * The remaining arguments are the same as for udp_tx.
+ */
+void udp_tx_stream_begin (struct udp_tx_stream *st, uint32_t addr_src,
+                          uint32_t addr_dst, uint16_t port_src,
+                          uint16_t port_dst, uint8_t *hdr_out);
+/* Add the next len bytes of the data section to the datagram of st, data
+ * can be split at any point
+ *
+ * Returns 0 on success and -1 if the datagram would be too long, st is left
+ * unchanged then
+ */
+int udp_tx_stream_update (struct udp_tx_stream *st, const uint8_t *data,
+                          size_t len);
+/* Complete the datagram of st
+ *
+ * verbose: Enable debug printing to stderr if true
+ * hdr_out: Output for the final UDP header, UDP_HDR_LEN bytes
+ * out_len: Length of the UDP datagram
+ */
+void udp_tx_stream_finish (struct udp_tx_stream *st, bool verbose,
+                           uint8_t *hdr_out, uint16_t *out_len);
+
 #endif /* TX_H */
@@ -32,22 +32,671 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include "config.h"
+#include "demux.h"
+#include "engine.h"
+#include "gro.h"
+#include "model.h"
+#include "pipeline.h"
+#include "record.h"
 #include "rx.h"
+#include "serve.h"
+#include "stats.h"
 #include "tx.h"
 
+/* Records per engine batch and the memory for their inputs and outputs */
+#define STREAM_BATCH_RECORDS 4096
+#define STREAM_BATCH_BYTES (32U << 20)
+
 void
 usage (char *name)
 {
   fprintf (stderr,
            "Usage:\n"
-           "\t%s <rx|tx> [--verbose|-v]\n"
+           "\t%s <rx|tx> [--verbose|-v] [--stream|-s [--threads|-j N]\n"
+           "\t\t[--pipeline|-P]]\n"
+           "\t\t[--width|-w BYTES] [--gso|-g SEGMENT] [--gro|-G LIMIT]\n"
+           "\t\t[--demux|-D PORT=SINK]... [--stats|-S FILE]\n"
+           "\t\t[--cut-through|-C] [--chunked|-k] [--lite|-L COVERAGE]\n"
+           "\t%s split\n"
+           "\t%s serve PATH [--width|-w BYTES]\n"
+           "\t%s call PATH <rx|tx> FILE [<rx|tx> FILE]...\n"
+           "\t%s model [--width|-w BYTES] [--clock|-c MHZ]\n"
+           "\t\t[--line-rate|-l GBPS] [--gap CYCLES]\n"
            "\nInput is read from stdin, output is sent to stdout. In verbose\n"
-           "mode, extra information about the transaction is printed to stderr\n",
-           name);
+           "mode, extra information about the transaction is printed to stderr\n"
+           "\nIn stream mode, input and output are sequences of length-\n"
+           "prefixed records and a status byte in each output record reports\n"
+           "errors. Records are spread over N threads if given, output stays\n"
+           "in input order. Verbose output is not available with threads\n"
+           "\nWith --pipeline in stream mode, reading, N worker threads, 1\n"
+           "by default, and writing overlap. Statistics are only written at\n"
+           "the end then\n"
+           "\nWith --gso in tx stream mode, the data of each record is split\n"
+           "into datagrams of SEGMENT bytes, with an output record each\n"
+           "\nWith --gro in rx stream mode, up to LIMIT datagrams of a flow\n"
+           "are merged into one output record with a segment size, see\n"
+           "gro.h. split turns such a stream back into plain output records\n"
+           "\nWith --demux in rx stream mode, the output records of each\n"
+           "destination PORT go to SINK, a file path, fd:N or drop. Records\n"
+           "of unbound ports and errors go to the default PORT, stdout\n"
+           "unless bound\n"
+           "\nWith --cut-through in rx stream mode, the payload is written\n"
+           "in chunks as each bus transfer is consumed and a trailer with\n"
+           "the status follows, see record.h\n"
+           "\nWith --chunked in tx mode, the data is processed as it arrives\n"
+           "and never held as a whole. The header is completed in place if\n"
+           "the output is seekable, otherwise the length and checksum\n"
+           "follow the data\n"
+           "\nWith --lite in tx mode, UDP-Lite datagrams are built with\n"
+           "the checksum over the first COVERAGE bytes, 0 for all of them.\n"
+           "rx handles UDP-Lite records by their protocol\n"
+           "\nWith --stats in rx mode, per-flow counters are written to FILE\n"
+           "as JSON at the end and after the next record on SIGUSR1, -\n"
+           "stands for stderr\n"
+           "\nserve listens on the UNIX domain socket PATH for rx and tx\n"
+           "requests until killed, see serve.h for the protocol. call sends\n"
+           "the stream input records of each FILE to it as rx or tx\n"
+           "requests on one connection and writes the responses\n"
+           "\nmodel runs an rx input stream through a cycle model of the\n"
+           "datapath and reports the timing at a clock of MHZ, 250 by\n"
+           "default, against a line rate of GBPS, 10 by default, with\n"
+           "CYCLES idle between datagrams, see model.h\n"
+           "\nThe receive datapath bus width is a power of two from %d to %d\n"
+           "bytes, %d by default\n",
+           name, name, name, name, name, UDP_DATA_WIDTH_MIN,
+           UDP_DATA_WIDTH_MAX, UDP_DATA_WIDTH_BYTES);
+}
+
+/* Process a single record making up all of the input */
+static int
+run_single (record_fn *fn, bool verbose, size_t in_max, FILE *fp_in,
+            FILE *fp_out, uint8_t *buf_in, uint8_t *buf_out)
+{
+  size_t len, out_len;
+  uint8_t status;
+
+  len = fread (buf_in, 1, in_max, fp_in);
+  if (in_max != len)
+    assert (!ferror (fp_in));
+  status = fn (verbose, buf_in, len, buf_out, &out_len);
+  if (RECORD_STATUS_OK != status)
+    {
+      fprintf (stderr, "Transfer error: %x\n", status);
+      return EXIT_FAILURE;
+    }
+  assert (1 == fwrite (buf_out, out_len, 1, fp_out));
+
+  return EXIT_SUCCESS;
+}
+
+/* Bytes of data read and written at a time by run_tx_chunked */
+#define TX_CHUNK_LEN 4096
+
+/* Process a TX input record making up all of the input a chunk at a time,
+ * writing each chunk straight through. The header is patched once the data
+ * is complete if fp_out is seekable, otherwise its length and checksum
+ * follow the data.
+ */
+static int
+run_tx_chunked (bool verbose, FILE *fp_in, FILE *fp_out)
+{
+  struct udp_tx_stream st;
+  uint8_t in_hdr[RECORD_TX_IN_HDR_LEN], out_hdr[RECORD_TX_OUT_HDR_LEN];
+  uint8_t udp_hdr[UDP_HDR_LEN], buf[TX_CHUNK_LEN];
+  uint32_t addr_src, addr_dst;
+  uint16_t port_src, port_dst, dgram_len;
+  off_t hdr_off;
+  size_t len;
+
+  if (1 != fread (in_hdr, sizeof (in_hdr), 1, fp_in))
+    {
+      assert (!ferror (fp_in));
+      fprintf (stderr, "Transfer error: %x\n", RECORD_STATUS_MALFORMED);
+      return EXIT_FAILURE;
+    }
+  memcpy (&addr_src, &in_hdr[0], sizeof (addr_src));
+  memcpy (&addr_dst, &in_hdr[4], sizeof (addr_dst));
+  memcpy (&port_src, &in_hdr[8], sizeof (port_src));
+  memcpy (&port_dst, &in_hdr[10], sizeof (port_dst));
+  memcpy (&out_hdr[0], &addr_src, sizeof (addr_src));
+  memcpy (&out_hdr[4], &addr_dst, sizeof (addr_dst));
+  out_hdr[8] = UDP_PROTO;
+  assert (1 == fwrite (out_hdr, sizeof (out_hdr), 1, fp_out));
+  hdr_off = ftello (fp_out);
+  /* Writes to a file opened for appending go to its end even after a seek,
+   * so it gets the trailer like a pipe
+   */
+  if (O_APPEND & fcntl (fileno (fp_out), F_GETFL))
+    hdr_off = -1;
+  udp_tx_stream_begin (&st, addr_src, addr_dst, port_src, port_dst, udp_hdr);
+  assert (1 == fwrite (udp_hdr, sizeof (udp_hdr), 1, fp_out));
+  while (0 != (len = fread (buf, 1, sizeof (buf), fp_in)))
+    {
+      if (0 != udp_tx_stream_update (&st, buf, len))
+        {
+          fprintf (stderr, "Transfer error: %x\n", RECORD_STATUS_MALFORMED);
+          return EXIT_FAILURE;
+        }
+      assert (1 == fwrite (buf, len, 1, fp_out));
+    }
+  assert (!ferror (fp_in));
+  udp_tx_stream_finish (&st, verbose, udp_hdr, &dgram_len);
+  /* Pipes and terminals can't seek */
+  if (0 <= hdr_off && 0 == fseeko (fp_out, hdr_off, SEEK_SET))
+    {
+      assert (1 == fwrite (udp_hdr, sizeof (udp_hdr), 1, fp_out));
+      assert (0 == fseeko (fp_out, 0, SEEK_END));
+    }
+  else
+    assert (1 == fwrite (&udp_hdr[UDP_HDR_OFF_LEN],
+                         UDP_HDR_LEN - UDP_HDR_OFF_LEN, 1, fp_out));
+
+  return EXIT_SUCCESS;
+}
+
+/* Output of the flow statistics, NULL if they are disabled */
+static const char *stats_path;
+/* Set by SIGUSR1 to dump the statistics so far */
+static volatile sig_atomic_t stats_requested;
+
+static void
+stats_signal (int sig)
+{
+  (void)sig;
+  stats_requested = 1;
+}
+
+/* Write the flow statistics to stats_path, stderr for "-" */
+static int
+stats_write (void)
+{
+  FILE *fp;
+  int ret;
+
+  if (0 == strcmp (stats_path, "-"))
+    return stats_dump_json (stderr);
+  fp = fopen (stats_path, "w");
+  if (NULL == fp)
+    {
+      perror (stats_path);
+      return -1;
+    }
+  ret = stats_dump_json (fp);
+  if (0 != fclose (fp))
+    ret = -1;
+
+  return ret;
+}
+
+/* Dump the statistics if asked to by a signal. Called between records or
+ * batches, when no worker is updating them.
+ */
+static void
+stats_poll (void)
+{
+  if (stats_requested)
+    {
+      stats_requested = 0;
+      stats_write ();
+    }
+}
+
+/* Destination of stream output records */
+struct stream_out {
+    FILE *fp;
+    /* Coalescing stage in front of fp, NULL if disabled */
+    struct gro *gro;
+    /* Demultiplexer used instead of fp, NULL if disabled */
+    struct demux *demux;
+};
+
+/* Write one stream output record */
+static int
+stream_write (struct stream_out *out, uint8_t status, const uint8_t *buf,
+              size_t len)
+{
+  if (NULL != out->demux)
+    return demux_dispatch (out->demux, status, buf, len);
+  if (NULL != out->gro)
+    return gro_add (out->gro, out->fp, status, buf, len);
+  return record_write (out->fp, status, buf, len);
+}
+
+/* Write out what is held back at the end of the stream */
+static int
+stream_flush (struct stream_out *out)
+{
+  if (NULL != out->gro)
+    return gro_flush (out->gro, out->fp);
+  return 0;
+}
+
+/* Process framed records until the end of the input */
+static int
+run_stream (record_fn *fn, bool verbose, FILE *fp_in, struct stream_out *out,
+            uint8_t *buf_in, uint8_t *buf_out)
+{
+  size_t len, out_len;
+  uint8_t status;
+  int ret;
+
+  while (1 != (ret = record_read (fp_in, buf_in, RECORD_MAX_LEN, &len)))
+    {
+      if (0 != ret)
+        {
+          fprintf (stderr, "Truncated record in input stream\n");
+          return EXIT_FAILURE;
+        }
+      if (RECORD_MAX_LEN < len)
+        {
+          status = RECORD_STATUS_MALFORMED;
+          out_len = 0;
+        }
+      else
+        status = fn (verbose, buf_in, len, buf_out, &out_len);
+      assert (0 == stream_write (out, status, buf_out, out_len));
+      stats_poll ();
+    }
+  assert (0 == stream_flush (out));
+
+  return EXIT_SUCCESS;
+}
+
+/* Process framed RX records into cut-through output until the end of the
+ * input
+ */
+static int
+run_stream_cut (FILE *fp_in, FILE *fp_out)
+{
+  size_t len;
+  int ret;
+
+  while (1 != (ret = record_read_len (fp_in, &len)))
+    {
+      if (0 != ret || 0 != record_rx_cut (fp_in, len, fp_out))
+        {
+          fprintf (stderr, "Truncated record in input stream\n");
+          return EXIT_FAILURE;
+        }
+      stats_poll ();
+    }
+
+  return EXIT_SUCCESS;
+}
+
+/* Process framed TX records, splitting the data of each into datagrams of
+ * seg_len bytes
+ */
+static int
+run_stream_gso (bool verbose, size_t seg_len, FILE *fp_in, FILE *fp_out,
+                uint8_t *buf_in)
+{
+  size_t len, out_len;
+  uint8_t *buf_out, status;
+  int ret;
+
+  buf_out = malloc (RECORD_GSO_OUT_MAX (RECORD_MAX_LEN, seg_len));
+  if (NULL == buf_out)
+    {
+      fprintf (stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+  while (1 != (ret = record_read (fp_in, buf_in, RECORD_MAX_LEN, &len)))
+    {
+      if (0 != ret)
+        {
+          fprintf (stderr, "Truncated record in input stream\n");
+          free (buf_out);
+          return EXIT_FAILURE;
+        }
+      if (RECORD_MAX_LEN < len)
+        status = RECORD_STATUS_MALFORMED;
+      else
+        status = record_tx_gso (verbose, buf_in, len, seg_len, buf_out,
+                                &out_len);
+      /* The output is a sequence of complete records already */
+      if (RECORD_STATUS_OK == status)
+        assert (1 == fwrite (buf_out, out_len, 1, fp_out));
+      else
+        assert (0 == record_write (fp_out, status, buf_out, 0));
+    }
+  free (buf_out);
+
+  return EXIT_SUCCESS;
+}
+
+static int
+stream_write_out (void *arg, uint8_t status, const uint8_t *buf, size_t len)
+{
+  return stream_write (arg, status, buf, len);
+}
+
+/* Process framed records with reading, nworkers workers and writing
+ * overlapped, see pipeline.h
+ */
+static int
+run_stream_pipelined (record_fn *fn, unsigned nworkers, FILE *fp_in,
+                      struct stream_out *out)
+{
+  int status = EXIT_SUCCESS;
+
+  if (0 != pipeline_run (fn, nworkers, fp_in, stream_write_out, out))
+    {
+      fprintf (stderr, "Pipeline failed or truncated record in input "
+               "stream\n");
+      status = EXIT_FAILURE;
+    }
+  assert (0 == stream_flush (out));
+
+  return status;
+}
+
+/* Process framed records in batches spread over nthreads threads */
+static int
+run_stream_threaded (record_fn *fn, unsigned nthreads, FILE *fp_in,
+                     struct stream_out *out)
+{
+  struct engine *e;
+  struct engine_job *jobs;
+  uint8_t *arena;
+  int ret, status;
+  bool done;
+
+  status = EXIT_SUCCESS;
+  e = engine_create (fn, nthreads);
+  jobs = malloc (STREAM_BATCH_RECORDS * sizeof (*jobs));
+  arena = malloc (STREAM_BATCH_BYTES);
+  if (NULL == e || NULL == jobs || NULL == arena)
+    {
+      fprintf (stderr, "Failed to set up %u threads\n", nthreads);
+      status = EXIT_FAILURE;
+      goto err;
+    }
+  done = false;
+  while (!done)
+    {
+      size_t n, used;
+
+      /* Fill the batch while a maximum size record still fits */
+      for (n = 0, used = 0; n < STREAM_BATCH_RECORDS
+           && STREAM_BATCH_BYTES - used
+              >= RECORD_MAX_LEN + RECORD_OUT_MAX (RECORD_MAX_LEN); ++n)
+        {
+          size_t len;
+
+          ret = record_read (fp_in, &arena[used], RECORD_MAX_LEN, &len);
+          if (0 != ret)
+            {
+              if (1 != ret)
+                {
+                  fprintf (stderr, "Truncated record in input stream\n");
+                  status = EXIT_FAILURE;
+                }
+              done = true;
+              break;
+            }
+          /* Over-long records are reported as malformed by fn */
+          jobs[n].in = &arena[used];
+          jobs[n].in_len = len;
+          if (RECORD_MAX_LEN < len)
+            len = RECORD_MAX_LEN;
+          used += len;
+          jobs[n].out = &arena[used];
+          used += RECORD_OUT_MAX (len);
+        }
+      engine_run (e, jobs, n);
+      for (size_t i = 0; i < n; ++i)
+        assert (0 == stream_write (out, jobs[i].status, jobs[i].out,
+                                   jobs[i].out_len));
+      stats_poll ();
+    }
+  assert (0 == stream_flush (out));
+
+err:
+  free (arena);
+  free (jobs);
+  if (NULL != e)
+    engine_destroy (e);
+
+  return status;
+}
+
+/* Files opened for --demux, shared by bindings with the same path */
+static struct {
+    const char *path;
+    FILE *fp;
+} demux_files[64];
+static size_t demux_nfiles;
+/* The default sink was dropped explicitly */
+static bool demux_drop;
+
+/* Bind a port as given by a --demux argument of the form PORT=SINK. PORT is
+ * a port number or default, SINK is a file path, fd:N or drop.
+ *
+ * Returns 0 on success
+ */
+static int
+demux_bind_arg (struct demux *d, const char *arg)
+{
+  struct demux_sink sink = {.type = DEMUX_SINK_DROP};
+  const char *eq, *path;
+  char *end;
+  int port;
+
+  eq = strchr (arg, '=');
+  if (NULL == eq)
+    return -1;
+  path = eq + 1;
+  if (0 == strncmp (arg, "default=", eq - arg + 1))
+    port = DEMUX_DEFAULT;
+  else
+    {
+      unsigned long p = strtoul (arg, &end, 0);
+
+      if (end != eq || arg == eq || DEMUX_PORTS <= p)
+        return -1;
+      port = p;
+    }
+  if (0 == strcmp (path, "drop"))
+    {
+      if (DEMUX_DEFAULT == port)
+        demux_drop = true;
+    }
+  else if (0 == strncmp (path, "fd:", 3))
+    {
+      long fd = strtol (path + 3, &end, 0);
+
+      if ('\0' != *end || path + 3 == end || 0 > fd || INT_MAX < fd)
+        return -1;
+      sink.type = DEMUX_SINK_FD;
+      sink.fd = fd;
+    }
+  else
+    {
+      size_t i;
+
+      for (i = 0; i < demux_nfiles; ++i)
+        if (0 == strcmp (demux_files[i].path, path))
+          break;
+      if (demux_nfiles == i)
+        {
+          if (sizeof (demux_files) / sizeof (demux_files[0]) == i)
+            return -1;
+          demux_files[i].fp = fopen (path, "wb");
+          if (NULL == demux_files[i].fp)
+            {
+              perror (path);
+              return -1;
+            }
+          demux_files[i].path = path;
+          ++demux_nfiles;
+        }
+      sink.type = DEMUX_SINK_FILE;
+      sink.fp = demux_files[i].fp;
+    }
+
+  return demux_bind (d, port, &sink);
+}
+
+/* Split coalesced records from rx --gro back into RX output records */
+static int
+run_split (FILE *fp_in, FILE *fp_out, uint8_t *buf_in, uint8_t *buf_out)
+{
+  size_t len, n;
+  int ret;
+
+  while (1 != (ret = record_read (fp_in, buf_in, RECORD_MAX_LEN, &len)))
+    {
+      if (0 != ret)
+        {
+          fprintf (stderr, "Truncated record in input stream\n");
+          return EXIT_FAILURE;
+        }
+      /* Error records are passed on */
+      if (1 > len || RECORD_STATUS_OK != buf_in[0])
+        {
+          assert (0 == record_write (fp_out, 1 > len
+                                             ? RECORD_STATUS_MALFORMED
+                                             : buf_in[0], buf_out, 0));
+          continue;
+        }
+      n = RECORD_MAX_LEN < len ? 0 : gro_count (&buf_in[1], len - 1);
+      if (0 == n)
+        assert (0 == record_write (fp_out, RECORD_STATUS_MALFORMED, buf_out,
+                                   0));
+      for (size_t i = 0; i < n; ++i)
+        {
+          size_t out_len = gro_segment (&buf_in[1], len - 1, i, buf_out);
+
+          assert (0 == record_write (fp_out, RECORD_STATUS_OK, buf_out,
+                                     out_len));
+        }
+    }
+
+  return EXIT_SUCCESS;
+}
+
+/* Run framed RX input records through the cycle model and report */
+static int
+run_model (FILE *fp_in, FILE *fp_out, uint8_t *buf_in, unsigned gap,
+           double clock_mhz, double line_gbps)
+{
+  struct model m;
+  size_t len;
+  int ret;
+
+  model_init (&m, udp_rx_get_width (), gap);
+  while (1 != (ret = record_read (fp_in, buf_in, RECORD_MAX_LEN, &len)))
+    {
+      uint32_t addr_src, addr_dst;
+
+      if (0 != ret)
+        {
+          fprintf (stderr, "Truncated record in input stream\n");
+          return EXIT_FAILURE;
+        }
+      if (RECORD_RX_IN_HDR_LEN > len || RECORD_MAX_LEN < len)
+        {
+          ++m.skipped;
+          continue;
+        }
+      memcpy (&addr_src, &buf_in[1], sizeof (addr_src));
+      memcpy (&addr_dst, &buf_in[5], sizeof (addr_dst));
+      model_dgram (&m, buf_in[0], addr_src, addr_dst,
+                   &buf_in[RECORD_RX_IN_HDR_LEN], len - RECORD_RX_IN_HDR_LEN);
+    }
+  model_report (&m, fp_out, clock_mhz, line_gbps);
+
+  return EXIT_SUCCESS;
+}
+
+/* Parse the arguments of serve mode and run the server */
+static int
+run_serve (int argc, char **argv)
+{
+  if (argc < 3)
+    {
+      fprintf (stderr, "Not enough arguments\n");
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+  for (int i = 3; i < argc; ++i)
+    {
+      if ((0 == strcmp (argv[i], "--width") || 0 == strcmp (argv[i], "-w"))
+          && i + 1 < argc)
+        {
+          char *end;
+          unsigned long width;
+
+          width = strtoul (argv[++i], &end, 0);
+          if ('\0' != *end || 0 != udp_rx_set_width (width))
+            {
+              fprintf (stderr, "Invalid bus width\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else
+        {
+          fprintf (stderr, "Invalid argument\n");
+          usage (argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
+  serve_unix (argv[2]);
+
+  return EXIT_FAILURE;
+}
+
+/* Send the files of rx and tx records given as OP FILE pairs to a server */
+static int
+run_call (int argc, char **argv)
+{
+  struct serve_batch batches[32];
+  size_t n = 0;
+  int status;
+
+  if (argc < 5 || 0 != (argc - 3) % 2
+      || sizeof (batches) / sizeof (batches[0]) < (size_t)(argc - 3) / 2)
+    {
+      fprintf (stderr, "Invalid arguments\n");
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+  for (int i = 3; i < argc; i += 2)
+    {
+      if (0 == strcmp (argv[i], "rx"))
+        batches[n].op = SERVE_OP_RX;
+      else if (0 == strcmp (argv[i], "tx"))
+        batches[n].op = SERVE_OP_TX;
+      else
+        {
+          fprintf (stderr, "Invalid argument\n");
+          usage (argv[0]);
+          return EXIT_FAILURE;
+        }
+      batches[n].fp = fopen (argv[i + 1], "rb");
+      if (NULL == batches[n].fp)
+        {
+          perror (argv[i + 1]);
+          return EXIT_FAILURE;
+        }
+      ++n;
+    }
+  status = serve_call (argv[2], batches, n, stdout);
+  for (size_t i = 0; i < n; ++i)
+    fclose (batches[i].fp);
+  if (0 != fflush (stdout))
+    status = -1;
+
+  return 0 == status ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int
@@ -55,16 +704,14 @@ main (int argc, char **argv)
 {
   int status;
   FILE *fp_in, *fp_out;
-  uint8_t buf_in[IP_MAX_DGRAM_LEN], buf_out[IP_MAX_DGRAM_LEN];
-  bool rx, verbose;
-  size_t len;
-  uint16_t buf_out_len;
-  uint32_t result_addr_src, result_addr_dst;
-  uint16_t port_dst, port_src;
-  uint16_t result_port_dst, result_port_src;
-  uint8_t result_proto;
-  uint8_t proto;
-  uint32_t addr_src, addr_dst;
+  uint8_t buf_in[RECORD_MAX_LEN], buf_out[RECORD_MAX_LEN];
+  bool rx, split, model, verbose, stream, cut, chunked, pipelined;
+  unsigned long nthreads, seg_len, gro_limit, gap;
+  long lite;
+  double clock_mhz, line_gbps;
+  static struct gro gro;
+  struct stream_out out;
+  struct demux *demux;
 
   if (argc < 2)
     {
@@ -72,8 +719,24 @@ main (int argc, char **argv)
       usage (argv[0]);
       return EXIT_FAILURE;
     }
+  if (0 == strcmp (argv[1], "serve"))
+    return run_serve (argc, argv);
+  if (0 == strcmp (argv[1], "call"))
+    return run_call (argc, argv);
+  split = false;
+  model = false;
   if (0 == strcmp (argv[1], "rx"))
     rx = true;
+  else if (0 == strcmp (argv[1], "split"))
+    {
+      rx = true;
+      split = true;
+    }
+  else if (0 == strcmp (argv[1], "model"))
+    {
+      rx = true;
+      model = true;
+    }
   else if (0 == strcmp (argv[1], "tx"))
     rx = false;
   else
@@ -83,96 +746,270 @@ main (int argc, char **argv)
       return EXIT_FAILURE;
     }
   verbose = false;
-  if (argc >= 3)
-    if (0 == strcmp (argv[2], "--verbose")
-        || 0 == strcmp (argv[2], "-v"))
-      verbose = true;
+  stream = false;
+  cut = false;
+  chunked = false;
+  lite = -1;
+  pipelined = false;
+  nthreads = 1;
+  seg_len = 0;
+  gro_limit = 0;
+  demux = NULL;
+  gap = 0;
+  clock_mhz = 250;
+  line_gbps = 10;
+  for (int i = 2; i < argc; ++i)
+    {
+      if (0 == strcmp (argv[i], "--verbose") || 0 == strcmp (argv[i], "-v"))
+        verbose = true;
+      else if (0 == strcmp (argv[i], "--stream")
+               || 0 == strcmp (argv[i], "-s"))
+        stream = true;
+      else if (0 == strcmp (argv[i], "--cut-through")
+               || 0 == strcmp (argv[i], "-C"))
+        cut = true;
+      else if (0 == strcmp (argv[i], "--chunked")
+               || 0 == strcmp (argv[i], "-k"))
+        chunked = true;
+      else if (0 == strcmp (argv[i], "--pipeline")
+               || 0 == strcmp (argv[i], "-P"))
+        pipelined = true;
+      else if ((0 == strcmp (argv[i], "--lite")
+                || 0 == strcmp (argv[i], "-L")) && i + 1 < argc)
+        {
+          char *end;
+
+          lite = strtol (argv[++i], &end, 0);
+          if ('\0' != *end || 0 > lite || UINT16_MAX < lite
+              || 0 != record_tx_set_lite (lite))
+            {
+              fprintf (stderr, "Invalid checksum coverage\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--threads")
+                || 0 == strcmp (argv[i], "-j")) && i + 1 < argc)
+        {
+          char *end;
+
+          nthreads = strtoul (argv[++i], &end, 0);
+          if ('\0' != *end || 0 == nthreads || 1024 < nthreads)
+            {
+              fprintf (stderr, "Invalid thread count\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--width")
+                || 0 == strcmp (argv[i], "-w")) && i + 1 < argc)
+        {
+          char *end;
+          unsigned long width;
+
+          width = strtoul (argv[++i], &end, 0);
+          if ('\0' != *end || 0 != udp_rx_set_width (width))
+            {
+              fprintf (stderr, "Invalid bus width\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--gso") || 0 == strcmp (argv[i], "-g"))
+               && i + 1 < argc)
+        {
+          char *end;
+
+          seg_len = strtoul (argv[++i], &end, 0);
+          if ('\0' != *end || 0 == seg_len
+              || UINT16_MAX - UDP_HDR_LEN < seg_len)
+            {
+              fprintf (stderr, "Invalid segment size\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--gro")
+                || 0 == strcmp (argv[i], "-G")) && i + 1 < argc)
+        {
+          char *end;
+
+          gro_limit = strtoul (argv[++i], &end, 0);
+          if ('\0' != *end || 0 == gro_limit || UINT16_MAX < gro_limit)
+            {
+              fprintf (stderr, "Invalid coalescing limit\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--clock")
+                || 0 == strcmp (argv[i], "-c")) && i + 1 < argc)
+        {
+          char *end;
+
+          clock_mhz = strtod (argv[++i], &end);
+          if ('\0' != *end || !(0 < clock_mhz))
+            {
+              fprintf (stderr, "Invalid clock frequency\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--line-rate")
+                || 0 == strcmp (argv[i], "-l")) && i + 1 < argc)
+        {
+          char *end;
+
+          line_gbps = strtod (argv[++i], &end);
+          if ('\0' != *end || !(0 < line_gbps))
+            {
+              fprintf (stderr, "Invalid line rate\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if (0 == strcmp (argv[i], "--gap") && i + 1 < argc)
+        {
+          char *end;
+
+          gap = strtoul (argv[++i], &end, 0);
+          if ('\0' != *end || UINT_MAX < gap)
+            {
+              fprintf (stderr, "Invalid gap\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else if ((0 == strcmp (argv[i], "--stats")
+                || 0 == strcmp (argv[i], "-S")) && i + 1 < argc)
+        stats_path = argv[++i];
+      else if ((0 == strcmp (argv[i], "--demux")
+                || 0 == strcmp (argv[i], "-D")) && i + 1 < argc)
+        {
+          if (NULL == demux)
+            demux = demux_create ();
+          if (NULL == demux || 0 != demux_bind_arg (demux, argv[++i]))
+            {
+              fprintf (stderr, "Invalid demultiplexer binding\n");
+              return EXIT_FAILURE;
+            }
+        }
+      else
+        {
+          fprintf (stderr, "Invalid argument\n");
+          usage (argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
 
   fp_in = stdin;
   fp_out = stdout;
-  if (rx)
-    {
-      /* RX input file format (all integer types are network byte order):
-       * Protocol
-       * Source address
-       * Destination address
-       * IP datagram data section (up to 65535 bytes)
-       */
-      assert (1 == fread (&proto, sizeof (proto), 1, fp_in));
-      assert (1 == fread (&addr_src, sizeof (addr_src), 1, fp_in));
-      assert (1 == fread (&addr_dst, sizeof (addr_dst), 1, fp_in));
-      len = fread (buf_in, 1, UINT16_MAX, fp_in);
-      if (UINT16_MAX != len)
-        assert (!ferror (fp_in));
-      status = udp_rx (verbose, addr_src, addr_dst, proto, buf_in, len,
-                       buf_out, &buf_out_len, &result_port_dst,
-                       &result_port_src, &result_addr_src);
+  if (0 != seg_len && (rx || !stream || 1 < nthreads))
+    {
+      fprintf (stderr, "Segmentation is only available in tx stream mode "
+               "without --threads\n");
+      return EXIT_FAILURE;
     }
-  else
+  if (0 != gro_limit && (!rx || split || !stream))
     {
-      /* TX input file format (all integer types are network byte order):
-       * Source address
-       * Destination address
-       * Source port
-       * Destination port
-       * Data for the UDP datagram data section (up to 65535 - 8 bytes)
-       */
-      assert (1 == fread (&addr_src, sizeof (addr_src), 1, fp_in));
-      assert (1 == fread (&addr_dst, sizeof (addr_dst), 1, fp_in));
-      assert (1 == fread (&port_src, sizeof (port_src), 1, fp_in));
-      assert (1 == fread (&port_dst, sizeof (port_dst), 1, fp_in));
-      len = fread (buf_in, 1, UINT16_MAX - UDP_HDR_LEN, fp_in);
-      if (UINT16_MAX - UDP_HDR_LEN != len)
-        assert (!ferror (fp_in));
-      status = udp_tx (verbose, addr_src, addr_dst, port_src, port_dst,
-                       buf_in, len, buf_out, &buf_out_len, &result_addr_src,
-                       &result_addr_dst, &result_proto);
-    }
-  if (0 != status)
+      fprintf (stderr, "Coalescing is only available in rx stream mode\n");
+      return EXIT_FAILURE;
+    }
+  if (NULL != demux && (!rx || split || !stream || 0 != gro_limit))
     {
-      fprintf (stderr, "Transfer error: %x\n", status);
-      status = EXIT_FAILURE;
-      goto err;
+      fprintf (stderr, "Demultiplexing is only available in rx stream mode "
+               "without --gro\n");
+      return EXIT_FAILURE;
     }
-  else
+  if (cut && (!rx || split || model || !stream || verbose || 1 < nthreads
+              || 0 != gro_limit || NULL != demux))
     {
-      if (rx)
-        {
-          /* RX output file format (all integer types are network byte order):
-           * Source address
-           * Source port
-           * Destination port
-           * UDP datagram's data payload
-           */
-          assert (1 == fwrite (&result_addr_src, sizeof (result_addr_src),
-                               1, fp_out));
-          assert (1 == fwrite (&result_port_src, sizeof (result_port_src),
-                               1, fp_out));
-          assert (1 == fwrite (&result_port_dst, sizeof (result_port_dst),
-                               1, fp_out));
-          if (0 != buf_out_len) /* Zero length payloads are legal */
-            assert (1 == fwrite (buf_out, buf_out_len, 1, fp_out));
-        }
-      else
+      fprintf (stderr, "Cut-through output is only available in rx stream "
+               "mode without --verbose, --threads, --gro or --demux\n");
+      return EXIT_FAILURE;
+    }
+  if (1 < nthreads && (split || model || !stream || verbose))
+    {
+      fprintf (stderr, "Threads are only available in rx and tx stream "
+               "mode without --verbose\n");
+      return EXIT_FAILURE;
+    }
+  if (chunked && (rx || stream))
+    {
+      fprintf (stderr, "Chunked processing is only available in tx mode "
+               "without --stream\n");
+      return EXIT_FAILURE;
+    }
+  if (0 <= lite && (rx || 0 != seg_len || chunked))
+    {
+      fprintf (stderr, "UDP-Lite is only available in tx mode without "
+               "--gso or --chunked\n");
+      return EXIT_FAILURE;
+    }
+  if (pipelined && (split || model || !stream || verbose || 0 != seg_len
+                    || cut))
+    {
+      fprintf (stderr, "Pipelining is only available in rx and tx stream "
+               "mode without --verbose, --gso or --cut-through\n");
+      return EXIT_FAILURE;
+    }
+  if (NULL != demux && DEMUX_SINK_DROP == demux->dflt.type && !demux_drop)
+    {
+      struct demux_sink sink = {.type = DEMUX_SINK_FILE, .fp = fp_out};
+
+      demux_bind (demux, DEMUX_DEFAULT, &sink);
+    }
+  if (NULL != stats_path)
+    {
+      struct sigaction sa;
+
+      if (!rx || split)
         {
-          /* TX output file format (all integer types are network byte order):
-           * Source address
-           * Destination address
-           * Protocol
-           * UDP datagram
-           */
-          assert (1 == fwrite (&result_addr_src, sizeof (result_addr_src),
-                               1, fp_out));
-          assert (1 == fwrite (&result_addr_dst, sizeof (result_addr_dst),
-                               1, fp_out));
-          assert (1 == fwrite (&result_proto, sizeof (result_proto), 1,
-                               fp_out));
-          assert (1 == fwrite (buf_out, buf_out_len, 1, fp_out));
+          fprintf (stderr, "Statistics are only available in rx mode\n");
+          return EXIT_FAILURE;
         }
+      memset (&sa, 0, sizeof (sa));
+      sa.sa_handler = stats_signal;
+      sa.sa_flags = SA_RESTART;
+      sigaction (SIGUSR1, &sa, NULL);
+      stats_enable ();
     }
-  status = EXIT_SUCCESS;
+  gro_init (&gro, gro_limit);
+  out.fp = fp_out;
+  out.gro = gro_limit ? &gro : NULL;
+  out.demux = demux;
+  /* See record.h and gro.h for the input and output formats */
+  if (model)
+    status = run_model (fp_in, fp_out, buf_in, gap, clock_mhz, line_gbps);
+  else if (split)
+    status = run_split (fp_in, fp_out, buf_in, buf_out);
+  else if (cut)
+    status = run_stream_cut (fp_in, fp_out);
+  else if (0 != seg_len)
+    status = run_stream_gso (verbose, seg_len, fp_in, fp_out, buf_in);
+  else if (pipelined)
+    status = run_stream_pipelined (rx ? record_rx : record_tx, nthreads,
+                                   fp_in, &out);
+  else if (stream && 1 < nthreads)
+    status = run_stream_threaded (rx ? record_rx : record_tx, nthreads,
+                                  fp_in, &out);
+  else if (stream)
+    status = run_stream (rx ? record_rx : record_tx, verbose, fp_in, &out,
+                         buf_in, buf_out);
+  else if (chunked)
+    status = run_tx_chunked (verbose, fp_in, fp_out);
+  else if (rx)
+    status = run_single (record_rx, verbose,
+                         RECORD_RX_IN_HDR_LEN + UINT16_MAX, fp_in, fp_out,
+                         buf_in, buf_out);
+  else
+    status = run_single (record_tx, verbose,
+                         RECORD_TX_IN_HDR_LEN + UINT16_MAX - UDP_HDR_LEN,
+                         fp_in, fp_out, buf_in, buf_out);
+  if (NULL != stats_path && 0 != stats_write ())
+    status = EXIT_FAILURE;
+  /* Buffered records of the --demux files are only written out here */
+  for (size_t i = 0; i < demux_nfiles; ++i)
+    if (0 != fclose (demux_files[i].fp))
+      {
+        perror (demux_files[i].path);
+        status = EXIT_FAILURE;
+      }
+  if (NULL != demux)
+    demux_destroy (demux);
 
-err:
   assert (0 == fclose (fp_out));
   assert (0 == fclose (fp_in));
 
@@ -0,0 +1,496 @@
+/*
+ * Input generator for the UDP executable spec
+ *
+ * Copyright 2017 Patrick Gauvin
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "record.h"
+#include "tx.h"
+
+/* Output buffer size for stream output */
+#define GEN_BUF_SIZE (4U << 20)
+/* Maximum number of entries in a --mix distribution */
+#define GEN_MIX_MAX 64
+/* Largest data section of a datagram */
+#define GEN_DATA_MAX (IP_MAX_DGRAM_LEN - UDP_HDR_LEN)
+
+/* Inclusive range of values in host byte order */
+struct gen_range {
+    uint32_t min;
+    uint32_t max;
+};
+
+struct gen_opts {
+    bool rx;
+    bool stream;
+    unsigned long count;
+    uint64_t seed;
+    /* Fixed payload, NULL for random data */
+    const char *data;
+    /* Payload lengths, uniform over len unless mix_n is set */
+    struct gen_range len;
+    size_t mix_n;
+    size_t mix_len[GEN_MIX_MAX];
+    unsigned long mix_weight[GEN_MIX_MAX];
+    unsigned long mix_total;
+    /* Force lengths odd (1) or even (0), -1 for either */
+    int parity;
+    struct gen_range addr_src, addr_dst, port_src, port_dst;
+    /* Ratios of rx datagrams sent without a checksum and with a wrong one */
+    double zero_checksum;
+    double bad_checksum;
+    /* UDP-Lite checksum coverage of rx datagrams, -1 for UDP */
+    long lite;
+    const char *path;
+};
+
+/* xorshift64*, the whole corpus follows from the seed */
+static uint64_t
+gen_rand (uint64_t *state)
+{
+  uint64_t x = *state;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * UINT64_C (0x2545f4914f6cdd1d);
+}
+
+/* Uniform value of r */
+static uint32_t
+gen_range_pick (uint64_t *state, const struct gen_range *r)
+{
+  uint64_t span = (uint64_t)r->max - r->min + 1;
+
+  return r->min + gen_rand (state) % span;
+}
+
+/* True with probability ratio */
+static bool
+gen_chance (uint64_t *state, double ratio)
+{
+  return (gen_rand (state) >> 11) * 0x1.0p-53 < ratio;
+}
+
+static void
+gen_fill (uint64_t *state, uint8_t *buf, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      uint64_t r = gen_rand (state);
+
+      memcpy (&buf[i], &r, sizeof (r));
+    }
+  if (i < len)
+    {
+      uint64_t r = gen_rand (state);
+
+      memcpy (&buf[i], &r, len - i);
+    }
+}
+
+static size_t
+gen_len (uint64_t *state, const struct gen_opts *o)
+{
+  size_t len;
+
+  if (NULL != o->data)
+    return strlen (o->data);
+  if (0 != o->mix_n)
+    {
+      unsigned long w = gen_rand (state) % o->mix_total;
+      size_t i;
+
+      for (i = 0; w >= o->mix_weight[i]; ++i)
+        w -= o->mix_weight[i];
+      len = o->mix_len[i];
+    }
+  else
+    len = gen_range_pick (state, &o->len);
+  if (0 <= o->parity && (int)(len % 2) != o->parity)
+    len = len < GEN_DATA_MAX ? len + 1 : len - 1;
+
+  return len;
+}
+
+/* Build one input record into rec, returns its length */
+static size_t
+gen_record (uint64_t *state, const struct gen_opts *o, uint8_t *rec)
+{
+  uint32_t addr_src, addr_dst;
+  uint16_t port_src, port_dst;
+  size_t len;
+
+  addr_src = htonl (gen_range_pick (state, &o->addr_src));
+  addr_dst = htonl (gen_range_pick (state, &o->addr_dst));
+  port_src = htons (gen_range_pick (state, &o->port_src));
+  port_dst = htons (gen_range_pick (state, &o->port_dst));
+  len = gen_len (state, o);
+
+  if (!o->rx)
+    {
+      memcpy (&rec[0], &addr_src, sizeof (addr_src));
+      memcpy (&rec[4], &addr_dst, sizeof (addr_dst));
+      memcpy (&rec[8], &port_src, sizeof (port_src));
+      memcpy (&rec[10], &port_dst, sizeof (port_dst));
+      if (NULL != o->data)
+        memcpy (&rec[RECORD_TX_IN_HDR_LEN], o->data, len);
+      else
+        gen_fill (state, &rec[RECORD_TX_IN_HDR_LEN], len);
+      return RECORD_TX_IN_HDR_LEN + len;
+    }
+  else
+    {
+      uint8_t data[GEN_DATA_MAX];
+      uint8_t *dgram = &rec[RECORD_RX_IN_HDR_LEN];
+      uint32_t out_addr_src, out_addr_dst;
+      uint16_t dgram_len, checksum;
+      uint8_t out_proto;
+
+      if (NULL != o->data)
+        memcpy (data, o->data, len);
+      else
+        gen_fill (state, data, len);
+      if (0 <= o->lite)
+        /* Datagrams no longer than the coverage are covered entirely */
+        udp_tx_lite (false, addr_src, addr_dst, port_src, port_dst, data,
+                     len, UDP_HDR_LEN + len <= (size_t)o->lite ? 0 : o->lite,
+                     dgram, &dgram_len, &out_addr_src, &out_addr_dst,
+                     &out_proto);
+      else
+        udp_tx (false, addr_src, addr_dst, port_src, port_dst, data, len,
+                dgram, &dgram_len, &out_addr_src, &out_addr_dst,
+                &out_proto);
+      rec[0] = out_proto;
+      memcpy (&rec[1], &out_addr_src, sizeof (out_addr_src));
+      memcpy (&rec[5], &out_addr_dst, sizeof (out_addr_dst));
+      if (gen_chance (state, o->zero_checksum))
+        checksum = 0;
+      else if (gen_chance (state, o->bad_checksum))
+        {
+          memcpy (&checksum, &dgram[UDP_HDR_OFF_CHK], sizeof (checksum));
+          /* Any other value is wrong, except 0 for no checksum */
+          do
+            checksum ^= gen_rand (state);
+          while (0 == checksum
+                 || 0 == memcmp (&checksum, &dgram[UDP_HDR_OFF_CHK], 2));
+        }
+      else
+        return RECORD_RX_IN_HDR_LEN + dgram_len;
+      memcpy (&dgram[UDP_HDR_OFF_CHK], &checksum, sizeof (checksum));
+      return RECORD_RX_IN_HDR_LEN + dgram_len;
+    }
+}
+
+/* Expand the first run of # in pattern to n, zero-padded to the length of
+ * the run
+ */
+static void
+gen_path (char *path, const char *pattern, unsigned long n)
+{
+  const char *hash = strchr (pattern, '#');
+  size_t width = strspn (hash, "#");
+
+  sprintf (path, "%.*s%0*lu%s", (int)(hash - pattern), pattern, (int)width,
+           n, hash + width);
+}
+
+/* Parse N or N-M into r, values no larger than max */
+static int
+parse_range (const char *arg, uint32_t max, struct gen_range *r)
+{
+  char *end;
+  unsigned long a, b;
+
+  a = strtoul (arg, &end, 0);
+  b = a;
+  if ('-' == *end)
+    b = strtoul (end + 1, &end, 0);
+  if (end == arg || '\0' != *end || a > b || b > max)
+    return -1;
+  r->min = a;
+  r->max = b;
+
+  return 0;
+}
+
+/* Parse A or A-B of dotted quad addresses into r */
+static int
+parse_addr_range (const char *arg, struct gen_range *r)
+{
+  char buf[2 * INET_ADDRSTRLEN];
+  const char *dash;
+  struct in_addr a, b;
+
+  if (sizeof (buf) <= strlen (arg))
+    return -1;
+  strcpy (buf, arg);
+  dash = strchr (arg, '-');
+  if (NULL != dash)
+    buf[dash - arg] = '\0';
+  if (1 != inet_pton (AF_INET, buf, &a))
+    return -1;
+  b = a;
+  if (NULL != dash && 1 != inet_pton (AF_INET, dash + 1, &b))
+    return -1;
+  r->min = ntohl (a.s_addr);
+  r->max = ntohl (b.s_addr);
+
+  return r->min <= r->max ? 0 : -1;
+}
+
+/* Parse LEN:WEIGHT,... or imix into the mix of o */
+static int
+parse_mix (const char *arg, struct gen_opts *o)
+{
+  if (0 == strcmp (arg, "imix"))
+    /* 7:4:1 of 40, 576 and 1500 byte IP packets */
+    arg = "12:7,548:4,1472:1";
+  o->mix_n = 0;
+  o->mix_total = 0;
+  while ('\0' != *arg)
+    {
+      char *end;
+      unsigned long len, weight;
+
+      if (GEN_MIX_MAX == o->mix_n)
+        return -1;
+      len = strtoul (arg, &end, 0);
+      if (end == arg || ':' != *end || GEN_DATA_MAX < len)
+        return -1;
+      arg = end + 1;
+      weight = strtoul (arg, &end, 0);
+      if (end == arg || 0 == weight || (',' != *end && '\0' != *end))
+        return -1;
+      arg = ',' == *end ? end + 1 : end;
+      o->mix_len[o->mix_n] = len;
+      o->mix_weight[o->mix_n++] = weight;
+      o->mix_total += weight;
+    }
+
+  return 0 == o->mix_n ? -1 : 0;
+}
+
+static int
+parse_ratio (const char *arg, double *ratio)
+{
+  char *end;
+
+  *ratio = strtod (arg, &end);
+  return end == arg || '\0' != *end || !(0 <= *ratio && 1 >= *ratio) ? -1
+                                                                       : 0;
+}
+
+void
+usage (char *name)
+{
+  fprintf (stderr,
+           "Usage:\n"
+           "\t%s <rx|tx> [--count|-n N] [--seed S] [--stream|-s]\n"
+           "\t\t[--output|-o PATH] [--data STRING] [--len MIN[-MAX]]\n"
+           "\t\t[--mix LEN:WEIGHT,...|imix] [--odd|--even]\n"
+           "\t\t[--src ADDR[-ADDR]] [--dst ADDR[-ADDR]]\n"
+           "\t\t[--sport PORT[-PORT]] [--dport PORT[-PORT]]\n"
+           "\t\t[--zero-checksum RATIO] [--bad-checksum RATIO]\n"
+           "\t\t[--lite COVERAGE]\n"
+           "\nWrites N input records for the udp program, 1 by default.\n"
+           "Every field is picked uniformly from its range, lengths are\n"
+           "UDP data section lengths. Payloads are random unless given with\n"
+           "--data. Checksum ratios apply to rx records. With --lite, rx\n"
+           "records are UDP-Lite with the checksum over the first COVERAGE\n"
+           "bytes of the datagram, 0 for all of it.\n"
+           "\nWith --stream, the records are written as one length-prefixed\n"
+           "stream to PATH or stdout. Otherwise each record goes to a file\n"
+           "of its own. If N is larger than 1, the first run of # in PATH\n"
+           "is replaced by the record number, e.g. rx-######.bin\n",
+           name);
+}
+
+int
+main (int argc, char **argv)
+{
+  static uint8_t rec[RECORD_MAX_LEN];
+  struct gen_opts o;
+  uint64_t state;
+  FILE *fp;
+
+  if (argc < 2)
+    {
+      fprintf (stderr, "Not enough arguments\n");
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+  memset (&o, 0, sizeof (o));
+  if (0 == strcmp (argv[1], "rx"))
+    o.rx = true;
+  else if (0 != strcmp (argv[1], "tx"))
+    {
+      fprintf (stderr, "Invalid argument\n");
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+  o.count = 1;
+  o.seed = 1;
+  o.len.max = 1472;
+  o.parity = -1;
+  o.lite = -1;
+  o.addr_src.min = o.addr_src.max = 0x7f000001;
+  o.addr_dst.min = o.addr_dst.max = 0x01020304;
+  o.port_src.min = o.port_src.max = 60001;
+  o.port_dst.min = o.port_dst.max = 60000;
+  for (int i = 2; i < argc; ++i)
+    {
+      const char *opt = argv[i], *arg = i + 1 < argc ? argv[i + 1] : NULL;
+      int ret = 0;
+      char *end;
+
+      if (0 == strcmp (opt, "--stream") || 0 == strcmp (opt, "-s"))
+        {
+          o.stream = true;
+          continue;
+        }
+      if (0 == strcmp (opt, "--odd") || 0 == strcmp (opt, "--even"))
+        {
+          o.parity = 0 == strcmp (opt, "--odd");
+          continue;
+        }
+      if (NULL == arg)
+        ret = -1;
+      else if (0 == strcmp (opt, "--count") || 0 == strcmp (opt, "-n"))
+        {
+          o.count = strtoul (arg, &end, 0);
+          ret = end == arg || '\0' != *end ? -1 : 0;
+        }
+      else if (0 == strcmp (opt, "--seed"))
+        {
+          o.seed = strtoull (arg, &end, 0);
+          ret = end == arg || '\0' != *end ? -1 : 0;
+        }
+      else if (0 == strcmp (opt, "--output") || 0 == strcmp (opt, "-o"))
+        o.path = arg;
+      else if (0 == strcmp (opt, "--data"))
+        {
+          o.data = arg;
+          ret = GEN_DATA_MAX < strlen (arg) ? -1 : 0;
+        }
+      else if (0 == strcmp (opt, "--len"))
+        ret = parse_range (arg, GEN_DATA_MAX, &o.len);
+      else if (0 == strcmp (opt, "--mix"))
+        ret = parse_mix (arg, &o);
+      else if (0 == strcmp (opt, "--src"))
+        ret = parse_addr_range (arg, &o.addr_src);
+      else if (0 == strcmp (opt, "--dst"))
+        ret = parse_addr_range (arg, &o.addr_dst);
+      else if (0 == strcmp (opt, "--sport"))
+        ret = parse_range (arg, UINT16_MAX, &o.port_src);
+      else if (0 == strcmp (opt, "--dport"))
+        ret = parse_range (arg, UINT16_MAX, &o.port_dst);
+      else if (0 == strcmp (opt, "--zero-checksum"))
+        ret = parse_ratio (arg, &o.zero_checksum);
+      else if (0 == strcmp (opt, "--bad-checksum"))
+        ret = parse_ratio (arg, &o.bad_checksum);
+      else if (0 == strcmp (opt, "--lite"))
+        {
+          o.lite = strtol (arg, &end, 0);
+          ret = end == arg || '\0' != *end || 0 > o.lite
+                || UINT16_MAX < o.lite
+                || (0 != o.lite && UDP_HDR_LEN > o.lite) ? -1 : 0;
+        }
+      else
+        ret = -1;
+      if (0 != ret)
+        {
+          fprintf (stderr, "Invalid argument: %s\n", opt);
+          usage (argv[0]);
+          return EXIT_FAILURE;
+        }
+      ++i;
+    }
+  if (!o.stream && 1 < o.count && (NULL == o.path || !strchr (o.path, '#')
+                                    || PATH_MAX <= strlen (o.path) + 20))
+    {
+      fprintf (stderr, "Several records need --stream or a file name "
+               "pattern\n");
+      return EXIT_FAILURE;
+    }
+
+  /* Seed 0 would be a fixed point of the generator */
+  state = o.seed * UINT64_C (0x9e3779b97f4a7c15) + 1;
+  if (!o.stream && 1 < o.count)
+    {
+      for (unsigned long n = 0; n < o.count; ++n)
+        {
+          size_t len = gen_record (&state, &o, rec);
+          char path[PATH_MAX];
+
+          gen_path (path, o.path, n);
+          fp = fopen (path, "wb");
+          if (NULL == fp || 1 != fwrite (rec, len, 1, fp) || 0 != fclose (fp))
+            {
+              perror (path);
+              return EXIT_FAILURE;
+            }
+        }
+      return EXIT_SUCCESS;
+    }
+
+  fp = NULL == o.path ? stdout : fopen (o.path, "wb");
+  if (NULL == fp)
+    {
+      perror (o.path);
+      return EXIT_FAILURE;
+    }
+  setvbuf (fp, NULL, _IOFBF, GEN_BUF_SIZE);
+  for (unsigned long n = 0; n < o.count && !ferror (fp); ++n)
+    {
+      size_t len = gen_record (&state, &o, rec);
+      uint32_t frame_len = htonl (len);
+
+      if (o.stream)
+        fwrite (&frame_len, sizeof (frame_len), 1, fp);
+      fwrite (rec, len, 1, fp);
+    }
+  if (ferror (fp) || 0 != fclose (fp))
+    {
+      perror (NULL == o.path ? "stdout" : o.path);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}